@@ -0,0 +1,79 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "headers.hpp"
+
+#include <chrono>
+
+/**
+ * Helpers shared by the benchmarks in this folder.
+*/
+
+typedef chrono::steady_clock Clock;
+
+/**
+ * @brief Run a function several times
+ *
+ * @param reps the number of runs
+ * @param f the function to time
+ * @return double the fastest run in milliseconds
+*/
+template <typename F>
+double bestOf(int reps, F &&f) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        auto start = Clock::now();
+        f();
+        best = min(best, chrono::duration<double, milli>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+/**
+ * @brief Run a function with cout discarded, for code that logs progress
+ *
+ * @param f the function to run
+*/
+template <typename F>
+void quietly(F &&f) {
+    streambuf *saved = cout.rdbuf(nullptr);
+    f();
+    cout.rdbuf(saved);
+}
+
+/**
+ * @brief Read every .txt file of a directory
+ *
+ * @param dir the corpus directory
+ * @return vector<string> the contents of the files
+*/
+inline vector<string> loadFiles(const string &dir) {
+    vector<string> texts;
+    for (const auto &entry : filesystem::directory_iterator(dir)) {
+        if (entry.path().extension() != ".txt") continue;
+        InputFile input(entry.path());
+        texts.emplace_back(input.data());
+    }
+    return texts;
+}
+
+/**
+ * @brief Tokenize a directory into words that outlive the tokenizer
+ *
+ * @param dir the corpus directory
+ * @param corpus owns the bytes of every word
+ * @return vector<string_view> the words in input order
+*/
+inline vector<string_view> loadWords(const string &dir, deque<string> &corpus) {
+    vector<string_view> words;
+    Tokenizer tokenizer;
+    for (const string &text : loadFiles(dir)) {
+        // the tokenizer's views only live until the next word
+        tokenizer.tokenize(text, [&](string_view w) {
+            words.push_back(corpus.emplace_back(w));
+        });
+    }
+    return words;
+}
+
+#endif // BENCH_HPP
@@ -0,0 +1,80 @@
+#include "bench.hpp"
+
+/**
+ * Micro-benchmark of block compression: writes the corpus as the sorted
+ * run of a mapper without a combiner and streams it back with a
+ * RunStream, raw and at several compression levels, then compresses
+ * and decompresses the reduce.part text of its counts. Throughputs are
+ * in raw (decoded) megabytes per second, so the levels compare with the
+ * raw files directly.
+ *
+ * Usage: ./bench/compress_bench [corpus_dir] [repetitions]
+*/
+
+int main(int argc, char *argv[]) {
+    string dir = argc > 1 ? argv[1] : "test_files";
+    int reps = argc > 2 ? stoi(argv[2]) : 3;
+
+    deque<string> corpus;
+    vector<string_view> words = loadWords(dir, corpus);
+    vector<string_view> sorted = words;
+    sort(sorted.begin(), sorted.end());
+
+    CountTable counts;
+    for (string_view w : words) counts.add(w, 1);
+    vector<pair<string_view, uint64_t>> records = counts.entries();
+    sort(records.begin(), records.end(), sortByValue);
+    string text;
+    for (auto &[key, count] : records) {
+        text.append(key);
+        text.push_back(',');
+        text.append(to_string(count));
+        text.push_back('\n');
+    }
+    cout << "words: " << words.size() << ", distinct: " << records.size() << endl;
+
+    string scratch = (filesystem::temp_directory_path() / "mapreduce-bench").string();
+    filesystem::create_directories(scratch);
+    string filename = scratch + "/run.bin";
+
+    double raw = 0;
+    for (int level : {0, 1, 4, COMPRESS_MAX_LEVEL}) {
+        uint64_t stored = 0;
+        double t_write = bestOf(reps, [&] {
+            RunWriter writer(level);
+            for (string_view w : sorted) writer.add(w, 1);
+            string run = writer.finish();
+            stored = run.size();
+            commitFile(filename, run);
+        });
+
+        uint64_t read = 0;
+        double t_read = bestOf(reps, [&] {
+            RunStream stream(filename, 0, 1 << 20);
+            read = 0;
+            while (stream.next()) read++;
+        });
+        if (read != sorted.size()) cout << "run read back " << read << " records" << endl;
+
+        if (!level) raw = stored;
+        cout << "run level " << level << "   : " << stored << " bytes (" << raw / stored << "x), write "
+             << raw / 1e3 / t_write << " MB/s, read " << raw / 1e3 / t_read << " MB/s" << endl;
+    }
+
+    for (int level : {1, 4, COMPRESS_MAX_LEVEL}) {
+        string packed, decoded;
+        double t_compress = bestOf(reps, [&] { packed = compressBlocks(text, level); });
+        double t_decompress = bestOf(reps, [&] {
+            decoded.clear();
+            decompressBlocks(packed, decoded);
+        });
+        if (decoded != text) cout << "text did not round trip" << endl;
+
+        cout << "text level " << level << "  : " << packed.size() << " of " << text.size() << " bytes ("
+             << double(text.size()) / packed.size() << "x), compress " << text.size() / 1e3 / t_compress
+             << " MB/s, decompress " << text.size() / 1e3 / t_decompress << " MB/s" << endl;
+    }
+
+    filesystem::remove_all(scratch);
+    return 0;
+}
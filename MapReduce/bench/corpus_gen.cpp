@@ -0,0 +1,103 @@
+#include "bench.hpp"
+
+#include <cmath>
+
+/**
+ * Synthetic corpus generator: writes Zipf-distributed English-like text,
+ * so benchmarks can run on inputs of any size with a known vocabulary.
+ * The word of rank r (0 is the most frequent) is r written in bijective
+ * base 26 ("a", ..., "z", "aa", ...), so frequent words are short. Lines
+ * hold 8 to 15 words, start with a capital letter and sometimes contain
+ * a comma, which exercises the tokenizer's lowercasing and splitting.
+ * The output only depends on the arguments, including the seed.
+ *
+ * Usage: ./bench/corpus_gen <out_dir> [size[K|M|G]] [vocabulary] [files] [skew] [seed]
+*/
+
+/* bytes of a file buffered between writes */
+const size_t WRITE_BUFFER = 1 << 20;
+
+/**
+ * splitmix64, used instead of <random> so that the corpus is the same
+ * with every standard library
+*/
+typedef struct Random {
+    uint64_t state;
+
+    uint64_t next() {
+        uint64_t z = (this->state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    /* uniform in [0, 1) */
+    double uniform() {
+        return (this->next() >> 11) * 0x1.0p-53;
+    }
+} Random;
+
+string wordOfRank(uint64_t rank) {
+    string word;
+    for (uint64_t n = rank + 1; n > 0; n = (n - 1) / 26) {
+        word.push_back('a' + (n - 1) % 26);
+    }
+    return word;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: ./bench/corpus_gen <out_dir> [size[K|M|G]] [vocabulary] [files] [skew] [seed]" << endl;
+        return 1;
+    }
+    string dir = argv[1];
+    uint64_t size = argc > 2 ? parseSize(argv[2]) : 64 << 20;
+    size_t vocabulary = argc > 3 ? stoull(argv[3]) : 100000;
+    int nfiles = argc > 4 ? stoi(argv[4]) : 4;
+    double skew = argc > 5 ? stod(argv[5]) : 1.0;
+    Random random{argc > 6 ? stoull(argv[6]) : 42};
+
+    // cumulative Zipf weights, sampled by binary search
+    vector<string> words(vocabulary);
+    vector<double> cdf(vocabulary);
+    double total = 0;
+    for (size_t r = 0; r < vocabulary; r++) {
+        words[r] = wordOfRank(r);
+        total += 1.0 / pow(double(r + 1), skew);
+        cdf[r] = total;
+    }
+
+    filesystem::create_directories(dir);
+    uint64_t written = 0;
+    for (int f = 0; f < nfiles; f++) {
+        char name[32];
+        snprintf(name, sizeof(name), "/corpus-%02d.txt", f);
+        ofstream output(dir + name, ios::binary);
+
+        uint64_t target = size / nfiles + (f < int(size % nfiles));
+        string buffer;
+        uint64_t bytes = 0;
+        while (bytes < target) {
+            size_t nwords = 8 + random.next() % 8;
+            size_t line = buffer.size();
+            for (size_t i = 0; i < nwords; i++) {
+                size_t rank = upper_bound(cdf.begin(), cdf.end(), random.uniform() * total) - cdf.begin();
+                buffer.append(words[min(rank, vocabulary - 1)]);
+                if (i + 1 < nwords) buffer.append(random.next() % 16 ? " " : ", ");
+            }
+            buffer[line] -= 'a' - 'A';
+            buffer.push_back('\n');
+            bytes += buffer.size() - line;
+
+            if (buffer.size() >= WRITE_BUFFER) {
+                output.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+        output.write(buffer.data(), buffer.size());
+        written += bytes;
+    }
+
+    cout << "wrote " << written << " bytes in " << nfiles << " files to " << dir << endl;
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "bench.hpp"
+
+/**
+ * Micro-benchmark of the reduce-side aggregation: counts every word of
+ * the corpus with std::map, std::unordered_map and CountTable, then
+ * sorts the result once by (count desc, key asc) as the merge phase does.
+ *
+ * Usage: ./bench/hashtable_bench [corpus_dir] [repetitions]
+*/
+
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(string_view s) const {
+        return hash<string_view>{}(s);
+    }
+};
+
+/* both std containers probe with string_view and only build a string on insert */
+template <typename Table>
+size_t countStd(const vector<string_view> &words) {
+    Table counts;
+    for (string_view w : words) {
+        auto it = counts.find(w);
+        if (it == counts.end()) counts.emplace(string(w), 1);
+        else it->second++;
+    }
+
+    vector<pair<string_view, uint64_t>> sorted(counts.begin(), counts.end());
+    sort(sorted.begin(), sorted.end(), sortByValue);
+    return sorted.size();
+}
+
+size_t countTable(const vector<string_view> &words) {
+    CountTable counts;
+    for (string_view w : words) counts.add(w, 1);
+
+    vector<pair<string_view, uint64_t>> sorted = counts.entries();
+    sort(sorted.begin(), sorted.end(), sortByValue);
+    return sorted.size();
+}
+
+int main(int argc, char *argv[]) {
+    string dir = argc > 1 ? argv[1] : "test_files";
+    int reps = argc > 2 ? stoi(argv[2]) : 5;
+
+    deque<string> corpus;
+    vector<string_view> words = loadWords(dir, corpus);
+
+    cout << "words: " << words.size() << endl;
+
+    size_t distinct = 0;
+    double t_map = bestOf(reps, [&] { distinct = countStd<map<string, uint64_t, less<>>>(words); });
+    double t_umap = bestOf(reps, [&] { distinct = countStd<unordered_map<string, uint64_t, StringHash, equal_to<>>>(words); });
+    double t_table = bestOf(reps, [&] { distinct = countTable(words); });
+    cout << "distinct: " << distinct << endl;
+
+    auto report = [&](const char *name, double ms) {
+        cout << name << ": " << ms << " ms, "
+             << ms * 1e6 / words.size() << " ns/word" << endl;
+    };
+    report("std::map          ", t_map);
+    report("std::unordered_map", t_umap);
+    report("CountTable        ", t_table);
+
+    return 0;
+}
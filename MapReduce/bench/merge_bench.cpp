@@ -0,0 +1,79 @@
+#include "bench.hpp"
+
+/**
+ * Micro-benchmark of the final ordering: sorts the reduced counts of the
+ * corpus by (count desc, key asc) inside nreduce reducers and k-way
+ * merges the sorted reduce.part texts as the merge phase does, against a
+ * single global sort of every record.
+ *
+ * Usage: ./bench/merge_bench [corpus_dir] [nreduce] [repetitions]
+*/
+
+typedef vector<pair<string_view, uint64_t>> Records;
+
+int main(int argc, char *argv[]) {
+    string dir = argc > 1 ? argv[1] : "test_files";
+    int nreduce = argc > 2 ? stoi(argv[2]) : 4;
+    int reps = argc > 3 ? stoi(argv[3]) : 5;
+
+    deque<string> corpus;
+    vector<string_view> words = loadWords(dir, corpus);
+    CountTable counts;
+    for (string_view w : words) counts.add(w, 1);
+    Records all = counts.entries();
+    cout << "distinct: " << all.size() << ", nreduce: " << nreduce << endl;
+
+    Partitioner partitioner(PARTITION_POLY, nreduce);
+    vector<Records> parts(nreduce);
+    for (auto &record : all) parts[partitioner.partition(record.first)].push_back(record);
+
+    double t_global = bestOf(reps, [&] {
+        Records sorted = all;
+        sort(sorted.begin(), sorted.end(), sortByValue);
+    });
+
+    vector<string> texts(nreduce);
+    double t_reduce = bestOf(reps, [&] {
+        for (int i = 0; i < nreduce; i++) {
+            Records sorted = parts[i];
+            sort(sorted.begin(), sorted.end(), sortByValue);
+            texts[i].clear();
+            for (auto &[key, count] : sorted) {
+                texts[i].append(key);
+                texts[i].push_back(',');
+                texts[i].append(to_string(count));
+                texts[i].push_back('\n');
+            }
+        }
+    });
+
+    size_t merged = 0;
+    double t_merge = bestOf(reps, [&] {
+        vector<TextReader> readers;
+        for (const string &text : texts) readers.emplace_back(text);
+        auto after = [&readers](int a, int b) {
+            return sortByValue({readers[b].key(), readers[b].count()}, {readers[a].key(), readers[a].count()});
+        };
+        priority_queue<int, vector<int>, decltype(after)> heap(after);
+        for (int i = 0; i < nreduce; i++) {
+            if (readers[i].next()) heap.push(i);
+        }
+
+        string output;
+        merged = 0;
+        while (!heap.empty()) {
+            int i = heap.top();
+            heap.pop();
+            output.append(readers[i].key());
+            output.push_back('\n');
+            merged++;
+            if (readers[i].next()) heap.push(i);
+        }
+    });
+
+    cout << "global sort       : " << t_global << " ms" << endl;
+    cout << "per-reducer sorts : " << t_reduce << " ms (sequential, " << nreduce << " reducers)" << endl;
+    cout << "k-way merge       : " << t_merge << " ms, " << merged << " records" << endl;
+
+    return 0;
+}
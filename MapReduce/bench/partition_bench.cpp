@@ -0,0 +1,50 @@
+#include "bench.hpp"
+
+/**
+ * Micro-benchmark of the Partitioner: assigns every word of the corpus
+ * to nreduce partitions with each partitioning mode and reports the cost
+ * per word and the load of the fullest partition relative to an even
+ * split. The range splits are chosen from every 64th word, as the Master
+ * would from a sample of the input.
+ *
+ * Usage: ./bench/partition_bench [corpus_dir] [repetitions]
+*/
+
+int main(int argc, char *argv[]) {
+    string dir = argc > 1 ? argv[1] : "test_files";
+    int reps = argc > 2 ? stoi(argv[2]) : 5;
+
+    deque<string> corpus;
+    vector<string_view> words = loadWords(dir, corpus);
+    cout << "words: " << words.size() << endl;
+
+    vector<pair<const char *, PartitionMode>> modes = {
+        {"poly  ", PARTITION_POLY},
+        {"wyhash", PARTITION_WYHASH},
+        {"range ", PARTITION_RANGE},
+    };
+
+    for (int nreduce : {4, 16, 64}) {
+        for (auto &[name, mode] : modes) {
+            vector<string> splits;
+            if (mode == PARTITION_RANGE) {
+                vector<string> samples;
+                for (size_t i = 0; i < words.size(); i += 64) samples.emplace_back(words[i]);
+                splits = Partitioner::chooseSplits(samples, nreduce);
+            }
+            Partitioner partitioner(mode, nreduce, splits);
+
+            vector<uint64_t> load(nreduce);
+            double ms = bestOf(reps, [&] {
+                fill(load.begin(), load.end(), 0);
+                for (string_view w : words) load[partitioner.partition(w)]++;
+            });
+
+            double skew = *max_element(load.begin(), load.end()) * double(nreduce) / words.size();
+            cout << "nreduce " << nreduce << " " << name << ": " << ms * 1e6 / words.size() << " ns/word, "
+                 << "max partition " << skew << "x even" << endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "bench.hpp"
+
+/**
+ * Micro-benchmark of the reducer: feeds the corpus to a single
+ * Reducer through the in-memory shuffle as sorted runs (k-way merge),
+ * as pipelined chunks (CountTable), as dictionary runs (merged on key
+ * ids) and as text blocks, the way nmaps mappers without a combiner
+ * would, and times the aggregation, the sort and the output of each.
+ *
+ * Usage: ./bench/reduce_bench [corpus_dir] [nmaps] [repetitions]
+*/
+
+int main(int argc, char *argv[]) {
+    string dir = argc > 1 ? argv[1] : "test_files";
+    int nmaps = argc > 2 ? stoi(argv[2]) : 4;
+    int reps = argc > 3 ? stoi(argv[3]) : 5;
+
+    deque<string> corpus;
+    vector<string_view> words = loadWords(dir, corpus);
+    cout << "words: " << words.size() << ", map outputs: " << nmaps << endl;
+
+    // one block per mapper, cut from consecutive slices of the corpus
+    vector<string> runs, dictionaries, texts;
+    RunWriter writer;
+    size_t run_bytes = 0, dictionary_bytes = 0;
+    for (int m = 0; m < nmaps; m++) {
+        vector<string_view> slice(words.begin() + words.size() * m / nmaps,
+                                  words.begin() + words.size() * (m + 1) / nmaps);
+        string text;
+        for (string_view w : slice) {
+            text.append(w);
+            text.append(",1\n");
+        }
+        texts.push_back(move(text));
+
+        KeyDictionary dictionary;
+        string records;
+        for (string_view w : slice) {
+            putVarint(records, dictionary.id(w));
+            putVarint(records, 1);
+        }
+        dictionaries.push_back(encodeDictionaryRun(dictionary.keys(), records, slice.size()));
+        dictionary_bytes += dictionaries.back().size();
+
+        sort(slice.begin(), slice.end());
+        for (string_view w : slice) writer.add(w, 1);
+        runs.push_back(writer.finish());
+        run_bytes += runs.back().size();
+    }
+    cout << "run bytes: " << run_bytes << ", dictionary run bytes: " << dictionary_bytes << endl;
+
+    Options options;
+    options.output_dir = (filesystem::temp_directory_path() / "mapreduce-bench").string();
+    filesystem::create_directories(options.output_dir);
+
+    auto time = [&](const char *name, const vector<string> &blocks, bool text, bool pipeline, bool dictionary) {
+        options.text_intermediate = text;
+        options.pipeline = pipeline;
+        options.dictionary = dictionary;
+        double ms = bestOf(reps, [&] {
+            Shuffle shuffle(1, 1);
+            for (const string &block : blocks) shuffle.put(0, string(block));
+            shuffle.close();
+            Reducer<WordCount> reducer(0, &options, nmaps, &shuffle);
+            quietly([&reducer] { reducer.reduce(); });
+        });
+        cout << name << ": " << ms << " ms, " << ms * 1e6 / words.size() << " ns/record" << endl;
+    };
+    time("run merge      ", runs, false, false, false);
+    time("chunk table    ", runs, false, true, false);
+    time("dictionary ids ", dictionaries, false, false, true);
+    time("text table     ", texts, true, false, false);
+
+    filesystem::remove_all(options.output_dir);
+    return 0;
+}
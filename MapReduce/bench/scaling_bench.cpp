@@ -0,0 +1,43 @@
+#include "bench.hpp"
+
+/**
+ * End-to-end scaling sweep: runs the whole word count job on the corpus
+ * for every power of two nworkers and nreduce up to the given limits,
+ * reusing one Master and its worker pool, and prints the best wall time
+ * of each configuration as a table.
+ *
+ * Usage: ./bench/scaling_bench [corpus_dir] [max_nworkers] [max_nreduce] [repetitions]
+*/
+
+int main(int argc, char *argv[]) {
+    string dir = argc > 1 ? argv[1] : "test_files";
+    int max_workers = argc > 2 ? stoi(argv[2]) : int(std::thread::hardware_concurrency());
+    int max_reduce = argc > 3 ? stoi(argv[3]) : max_workers;
+    int reps = argc > 4 ? stoi(argv[4]) : 3;
+
+    Options options;
+    options.input_dir = dir;
+    options.output_dir = (filesystem::temp_directory_path() / "mapreduce-scaling").string();
+    filesystem::create_directories(options.output_dir);
+
+    cout << "nworkers \\ nreduce (ms)";
+    for (int r = 1; r <= max_reduce; r *= 2) cout << "\t" << r;
+    cout << endl;
+
+    Master master;
+    for (int w = 1; w <= max_workers; w *= 2) {
+        cout << w;
+        for (int r = 1; r <= max_reduce; r *= 2) {
+            options.nworkers = w;
+            options.nreduce = r;
+            double ms = bestOf(reps, [&] {
+                quietly([&] { master.run(options); });
+            });
+            cout << "\t" << ms << flush;
+        }
+        cout << endl;
+    }
+
+    filesystem::remove_all(options.output_dir);
+    return 0;
+}
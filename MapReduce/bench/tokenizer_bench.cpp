@@ -0,0 +1,39 @@
+#include "bench.hpp"
+
+/**
+ * Micro-benchmark of the map-side tokenization: tokenizes the corpus
+ * with every classify kernel the CPU supports and reports the
+ * throughput of each.
+ *
+ * Usage: ./bench/tokenizer_bench [corpus_dir] [repetitions]
+*/
+
+int main(int argc, char *argv[]) {
+    string dir = argc > 1 ? argv[1] : "test_files";
+    int reps = argc > 2 ? stoi(argv[2]) : 5;
+
+    vector<string> texts = loadFiles(dir);
+    size_t bytes = 0;
+    for (const string &text : texts) bytes += text.size();
+    cout << "bytes: " << bytes << endl;
+
+    vector<pair<const char *, ClassifyKernel>> kernels = {{"scalar", classifyScalar}};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) kernels.emplace_back("sse4.2", classifySSE42);
+    if (__builtin_cpu_supports("avx2")) kernels.emplace_back("avx2  ", classifyAVX2);
+
+    for (auto &[name, kernel] : kernels) {
+        Tokenizer tokenizer(kernel);
+        size_t words = 0;
+        double ms = bestOf(reps, [&] {
+            words = 0;
+            for (const string &text : texts) {
+                tokenizer.tokenize(text, [&words](string_view) { words++; });
+            }
+        });
+        cout << name << ": " << ms << " ms, " << bytes / ms / 1e3 << " MB/s, "
+             << words << " words" << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "bench.hpp"
+
+#include <signal.h>
+
+/**
+ * Watch mode check for a reused Master: runs two watches one after the
+ * other on the same Master, each over its own input directory. Every
+ * watch starts with whole files, has a file appended to while it runs
+ * and is stopped with SIGINT, and its output must match a batch run over
+ * the final input.
+ *
+ * Usage: ./bench/watch_rerun [corpus_dir] [work_dir]
+*/
+
+/**
+ * @brief Read a whole file
+*/
+static string readFile(const string &path) {
+    ifstream in(path, ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Watch a directory with a reused Master while a file grows, then
+ *      compare the output with a batch run over the same files
+ *
+ * @param master the Master, reused across watches
+ * @param options the options of the watch, input_dir and output_dir set
+ * @param files the texts the input directory starts with
+ * @param appended the text appended to the first file during the watch
+ * @return true if the outputs match
+*/
+static bool watchOnce(Master &master, Options options, const vector<string> &files, const string &appended) {
+    filesystem::remove_all(options.input_dir);
+    filesystem::create_directories(options.input_dir);
+    for (size_t i = 0; i < files.size(); i++) {
+        ofstream(options.input_dir + "/file-" + to_string(i) + ".txt", ios::binary) << files[i];
+    }
+
+    // the signal reaches the watch in whichever thread it lands on
+    thread writer([&options, &appended] {
+        this_thread::sleep_for(chrono::milliseconds(4 * options.watch_interval));
+        ofstream(options.input_dir + "/file-0.txt", ios::binary | ios::app) << appended;
+        this_thread::sleep_for(chrono::milliseconds(4 * options.watch_interval));
+        kill(getpid(), SIGINT);
+    });
+    options.watch = true;
+    quietly([&] { master.run(options); });
+    writer.join();
+    string watched = readFile(options.output_dir + "/output.txt");
+
+    Options batch = options;
+    batch.watch = false;
+    batch.output_dir += "-batch";
+    filesystem::create_directories(batch.output_dir);
+    quietly([&] { master.run(batch); });
+    return watched == readFile(batch.output_dir + "/output.txt");
+}
+
+int main(int argc, char *argv[]) {
+    string dir = argc > 1 ? argv[1] : "test_files";
+    string work = argc > 2 ? argv[2] : (filesystem::temp_directory_path() / "mapreduce-watch-rerun").string();
+
+    vector<string> texts = loadFiles(dir);
+    if (texts.size() < 2) {
+        cerr << "watch_rerun needs two .txt files in " << dir << endl;
+        return 1;
+    }
+    string &first = texts[0], &second = texts[1];
+    size_t half = first.rfind('\n', first.size() / 2) + 1;
+
+    Options options;
+    options.nworkers = 3;
+    options.nreduce = 2;
+    options.watch_interval = 100;
+    options.input_dir = work + "/input";
+    options.output_dir = work + "/output";
+    filesystem::create_directories(options.output_dir);
+
+    // the second watch has fewer files than the first, and a new one at index 0
+    Master master;
+    bool ok = watchOnce(master, options, {first.substr(0, half), second}, first.substr(half));
+    cout << (ok ? "PASS" : "FAIL") << " first watch" << endl;
+    bool again = watchOnce(master, options, {second.substr(0, second.size() / 3)}, second.substr(second.size() / 3));
+    cout << (again ? "PASS" : "FAIL") << " second watch on the same Master" << endl;
+
+    filesystem::remove_all(work);
+    return ok && again ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#include "headers.hpp"
+
+/* first line of the manifest, bumped when the run or manifest layout changes */
+const string CACHE_MANIFEST_VERSION = "mapcache 1";
+
+/**
+ * @brief The cache directory of a job, one per job kind
+*/
+static string cacheDirectory(const Options &options) {
+    return options.output_dir + "/_cache/" + (options.job == JOB_BIGRAMS ? "bigrams" : "wordcount");
+}
+
+MapCache::MapCache(const Options &options) {
+    this->directory = cacheDirectory(options);
+    error_code error;
+    filesystem::create_directories(this->directory, error);
+    if (options.rebuild) return;
+
+    // path last, since it may contain spaces
+    ifstream manifest(this->directory + "/manifest");
+    string line;
+    if (!getline(manifest, line) || line != CACHE_MANIFEST_VERSION) return;
+    while (getline(manifest, line)) {
+        Fingerprint fingerprint;
+        istringstream fields(line);
+        fields >> fingerprint.size >> fingerprint.mtime >> fingerprint.hash;
+        fields.get();
+        string path;
+        if (fields && getline(fields, path) && !path.empty()) {
+            this->saved[path] = fingerprint;
+        }
+    }
+}
+
+bool MapCache::lookup(const string &path) {
+    Fingerprint fingerprint;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        fingerprint.size = st.st_size;
+        fingerprint.mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    }
+    InputFile input(path);
+    fingerprint.hash = hashKey(input.data());
+    string key = filesystem::absolute(path).string();
+    this->current[key] = fingerprint;
+
+    auto it = this->saved.find(key);
+    bool fresh = it != this->saved.end() &&
+        it->second.size == fingerprint.size &&
+        it->second.mtime == fingerprint.mtime &&
+        it->second.hash == fingerprint.hash;
+    this->fresh[key] = fresh;
+    return fresh;
+}
+
+bool MapCache::forgetStale() {
+    return this->writeManifest(false);
+}
+
+bool MapCache::commit(const vector<string> &runs) {
+    if (!this->writeManifest(true)) return false;
+
+    // runs of deleted files, or of splits that no longer exist
+    unordered_set<string> used(runs.begin(), runs.end());
+    error_code error;
+    for (const auto &entry : filesystem::directory_iterator(this->directory, error)) {
+        if (entry.path().extension() == ".bin" && !used.count(entry.path().string())) {
+            filesystem::remove(entry.path(), error);
+        }
+    }
+    return true;
+}
+
+bool MapCache::writeManifest(bool all) {
+    string manifest = CACHE_MANIFEST_VERSION + "\n";
+    for (auto &[path, fingerprint] : this->current) {
+        if (!all && !this->fresh[path]) continue;
+        manifest += to_string(fingerprint.size) + " " + to_string(fingerprint.mtime) + " " +
+            to_string(fingerprint.hash) + " " + path + "\n";
+    }
+
+    string filename = this->directory + "/manifest";
+    if (!commitFile(filename, manifest)) {
+        cerr << "Could not write the map cache manifest: " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+string MapCache::runFile(const Options &options, const string &path, const MapTask &task) {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long) hashKey(filesystem::absolute(path).string()));
+    return cacheDirectory(options) + "/" + name + "-" + to_string(task.begin) + "-" + to_string(task.end) + ".bin";
+}
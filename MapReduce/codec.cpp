@@ -0,0 +1,265 @@
+#include "headers.hpp"
+
+/* shortest match worth a sequence */
+const size_t MIN_MATCH = 4;
+
+/* farthest a match may start behind its copy */
+const size_t MAX_OFFSET = 65535;
+
+/* bits of the hash of 4 bytes that index the match table */
+const int HASH_BITS = 16;
+
+static inline uint32_t read32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/**
+ * @brief Count the equal bytes at a and b, 8 at a time, up to b + max
+*/
+static inline size_t matchLength(const char *a, const char *b, size_t max) {
+    size_t length = 0;
+    while (length + 8 <= max) {
+        uint64_t x, y;
+        memcpy(&x, a + length, sizeof(x));
+        memcpy(&y, b + length, sizeof(y));
+        if (x != y) return length + (__builtin_ctzll(x ^ y) >> 3);
+        length += 8;
+    }
+    while (length < max && a[length] == b[length]) length++;
+    return length;
+}
+
+/**
+ * @brief Append the bytes of a length that did not fit its nibble
+*/
+static void putLength(string &out, size_t length) {
+    length -= 15;
+    while (length >= 255) {
+        out.push_back(char(255));
+        length -= 255;
+    }
+    out.push_back(char(length));
+}
+
+/**
+ * @brief Read the bytes of a length that did not fit its nibble
+*/
+static bool getLength(string_view in, size_t &pos, size_t &length) {
+    while (pos < in.size()) {
+        unsigned char byte = in[pos++];
+        length += byte;
+        if (byte != 255) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Append a sequence, without a match for the last one of a block
+*/
+static void putSequence(string &out, string_view literals, size_t offset, size_t match) {
+    size_t extra = match ? match - MIN_MATCH : 0;
+    out.push_back(char((min<size_t>(literals.size(), 15) << 4) | min<size_t>(extra, 15)));
+    if (literals.size() >= 15) putLength(out, literals.size());
+    out.append(literals);
+    if (!match) return;
+
+    out.push_back(char(offset & 0xff));
+    out.push_back(char(offset >> 8));
+    if (extra >= 15) putLength(out, extra);
+}
+
+string compressBlock(string_view raw, int level) {
+    // positions are stored plus one, so 0 is an empty slot or the end of a chain
+    static thread_local vector<uint32_t> head, chain;
+    const char *src = raw.data();
+    size_t n = raw.size();
+    size_t depth = size_t(1) << (clamp(level, 1, COMPRESS_MAX_LEVEL) - 1);
+    head.assign(size_t(1) << HASH_BITS, 0);
+    if (depth > 1) chain.resize(n);
+
+    auto insert = [&](size_t p) {
+        uint32_t h = hash4(read32(src + p));
+        if (depth > 1) chain[p] = head[h];
+        head[h] = uint32_t(p + 1);
+    };
+
+    string out;
+    out.reserve(n / 2 + 16);
+    size_t anchor = 0, p = 0, misses = 0;
+    while (p + MIN_MATCH <= n) {
+        size_t best = 0, from = 0;
+        uint32_t candidate = head[hash4(read32(src + p))];
+        for (size_t d = 0; candidate && d < depth; d++) {
+            size_t c = candidate - 1;
+            if (p - c > MAX_OFFSET) break;
+            if (read32(src + c) == read32(src + p)) {
+                size_t length = MIN_MATCH + matchLength(src + c + MIN_MATCH, src + p + MIN_MATCH, n - p - MIN_MATCH);
+                if (length > best) {
+                    best = length;
+                    from = c;
+                }
+            }
+            candidate = depth > 1 ? chain[c] : 0;
+        }
+        insert(p);
+
+        if (!best) {
+            p += depth > 1 ? 1 : 1 + (misses++ >> 5);
+            continue;
+        }
+        misses = 0;
+
+        // the bytes before a match may match too
+        while (p > anchor && from > 0 && src[p - 1] == src[from - 1]) {
+            p--;
+            from--;
+            best++;
+        }
+        putSequence(out, raw.substr(anchor, p - anchor), p - from, best);
+
+        size_t end = p + best;
+        if (depth > 1) {
+            for (size_t q = p + 1; q < end && q + MIN_MATCH <= n; q++) insert(q);
+        } else if (end - 2 > p && end - 2 + MIN_MATCH <= n) {
+            insert(end - 2);
+        }
+        p = anchor = end;
+    }
+    putSequence(out, raw.substr(anchor), 0, 0);
+    return out;
+}
+
+bool decompressBlock(string_view packed, size_t raw, string &out) {
+    size_t base = out.size();
+    out.resize(base + raw);
+    char *dst = out.data() + base;
+    size_t i = 0, o = 0;
+
+    bool ok = false;
+    while (i < packed.size()) {
+        unsigned char token = packed[i++];
+        size_t literals = token >> 4;
+        if (literals == 15 && !getLength(packed, i, literals)) break;
+        if (literals > packed.size() - i || literals > raw - o) break;
+        memcpy(dst + o, packed.data() + i, literals);
+        i += literals;
+        o += literals;
+
+        // the last sequence ends the block after its literals
+        if (i == packed.size()) {
+            ok = o == raw;
+            break;
+        }
+
+        if (packed.size() - i < 2) break;
+        size_t offset = (unsigned char) packed[i] | (size_t((unsigned char) packed[i + 1]) << 8);
+        i += 2;
+        size_t length = token & 15;
+        if (length == 15 && !getLength(packed, i, length)) break;
+        length += MIN_MATCH;
+        if (offset == 0 || offset > o || length > raw - o) break;
+
+        // an overlapping match repeats the bytes it is copying
+        if (offset >= length) {
+            memcpy(dst + o, dst + o - offset, length);
+        } else {
+            for (size_t k = 0; k < length; k++) dst[o + k] = dst[o + k - offset];
+        }
+        o += length;
+    }
+
+    if (!ok) out.resize(base);
+    return ok;
+}
+
+void appendBlock(string &out, string_view raw, int level) {
+    string packed = compressBlock(raw, level);
+    bool shrunk = packed.size() < raw.size();
+    BlockHeader header = {uint32_t(raw.size()), uint32_t(shrunk ? packed.size() : raw.size())};
+    out.append((const char *) &header, sizeof(header));
+    out.append(shrunk ? string_view(packed) : raw);
+}
+
+bool decodeBlock(const BlockHeader &header, string_view stored, string &out) {
+    if (stored.size() != header.stored) return false;
+    if (header.stored == header.raw) {
+        out.append(stored);
+        return true;
+    }
+    return decompressBlock(stored, header.raw, out);
+}
+
+string compressBlocks(string_view raw, int level) {
+    string out;
+    for (size_t first = 0; first < raw.size(); first += COMPRESS_BLOCK) {
+        appendBlock(out, raw.substr(first, COMPRESS_BLOCK), level);
+    }
+    return out;
+}
+
+bool decompressBlocks(string_view blocks, string &out) {
+    size_t pos = 0;
+    while (pos < blocks.size()) {
+        BlockHeader header;
+        if (blocks.size() - pos < sizeof(header)) return false;
+        memcpy(&header, blocks.data() + pos, sizeof(header));
+        pos += sizeof(header);
+        if (header.stored > blocks.size() - pos ||
+            !decodeBlock(header, blocks.substr(pos, header.stored), out)
+        ) {
+            return false;
+        }
+        pos += header.stored;
+    }
+    return true;
+}
+
+BlockReader::BlockReader(const string &filename) : name(filename) {
+    this->fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (this->fd < 0 || fstat(this->fd, &st) != 0) {
+        cerr << "Could not open compressed file: " << filename << endl;
+        return;
+    }
+    this->end = st.st_size;
+}
+
+BlockReader::~BlockReader() {
+    if (this->fd >= 0) close(this->fd);
+}
+
+bool BlockReader::next(string_view &block) {
+    BlockHeader header;
+    if (this->fd < 0 || this->offset >= this->end) return false;
+    if (this->end - this->offset < sizeof(header) ||
+        pread(this->fd, &header, sizeof(header), this->offset) != sizeof(header) ||
+        header.stored > this->end - this->offset - sizeof(header)
+    ) {
+        cerr << "Corrupt compressed file: " << this->name << endl;
+        this->offset = this->end;
+        return false;
+    }
+
+    this->stored.resize(header.stored);
+    this->decoded.clear();
+    if (pread(this->fd, this->stored.data(), header.stored, this->offset + sizeof(header)) != ssize_t(header.stored) ||
+        !decodeBlock(header, this->stored, this->decoded)
+    ) {
+        cerr << "Corrupt compressed file: " << this->name << endl;
+        this->offset = this->end;
+        return false;
+    }
+    this->offset += sizeof(header) + header.stored;
+    block = this->decoded;
+    return true;
+}
+
+uint64_t BlockReader::size() const {
+    return this->end;
+}
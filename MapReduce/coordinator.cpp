@@ -0,0 +1,392 @@
+#include "headers.hpp"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/* milliseconds between checks for failed workers */
+const int POLL_INTERVAL = 50;
+
+/* times a task may be assigned before the job is aborted */
+const int MAX_TASK_ATTEMPTS = 4;
+
+/* backups start once at most this fraction of a phase's tasks is left */
+const double BACKUP_FRACTION = 0.25;
+
+/* a task is a straggler once it runs this many times the phase's median task */
+const double BACKUP_SLOWDOWN = 2.0;
+
+Coordinator::Coordinator(const Options &options, const vector<string> &files, const vector<MapTask> &tasks, const vector<string> &splits, JobStats *stats)
+    : options(options), files(files), map_tasks(tasks), splits(splits) {
+    this->stats = stats;
+    this->nmaps = tasks.size();
+    this->tasks = vector<Task>(this->nmaps + options.nreduce);
+    this->socket_path = options.output_dir + "/_master.sock";
+}
+
+Coordinator::~Coordinator() {
+    for (pid_t pid : this->children) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+    if (this->listener >= 0) {
+        close(this->listener);
+        unlink(this->socket_path.c_str());
+    }
+}
+
+bool Coordinator::run() {
+    this->listener = listenUnix(this->socket_path);
+    if (this->listener < 0) return false;
+    cout << "Waiting for workers on " << this->socket_path << endl;
+
+    for (int i = 0; i < this->options.nworkers; i++) {
+        this->spawn();
+    }
+
+    Stopwatch watch;
+    bool maps_done = this->nmaps == 0;
+    while (this->done < int(this->tasks.size()) && !this->failed) {
+        vector<pollfd> fds = {{this->listener, POLLIN, 0}};
+        vector<int> polled;
+        for (int w = 0; w < int(this->workers.size()); w++) {
+            if (!this->workers[w].alive) continue;
+            fds.push_back({this->workers[w].connection->fd(), POLLIN, 0});
+            polled.push_back(w);
+        }
+
+        if (poll(fds.data(), fds.size(), POLL_INTERVAL) < 0 && errno != EINTR) {
+            cerr << "poll failed: " << strerror(errno) << endl;
+            return false;
+        }
+        if (fds[0].revents & POLLIN) this->accept();
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (fds[i].revents) this->receive(polled[i - 1]);
+        }
+
+        this->checkHeartbeats();
+        this->superviseChildren();
+        this->assign();
+
+        if (!maps_done && this->done >= this->nmaps) {
+            maps_done = true;
+            this->stats->map.wall_ms = watch.wallMs();
+            cout << "Map tasks complete" << endl;
+        }
+    }
+    this->stats->reduce.wall_ms = watch.wallMs() - this->stats->map.wall_ms;
+
+    // the workers exit on EXIT, or once they see their socket or the listener close
+    close(this->listener);
+    unlink(this->socket_path.c_str());
+    this->listener = -1;
+    for (WorkerSlot &worker : this->workers) {
+        if (!worker.alive) continue;
+        // a losing backup copy would only rewrite files that are already committed
+        if (worker.pid && worker.task >= 0) kill(worker.pid, SIGKILL);
+        worker.connection->send(Message(MSG_EXIT));
+        worker.connection->close();
+    }
+    for (pid_t pid : this->children) {
+        waitpid(pid, nullptr, 0);
+    }
+    this->children.clear();
+
+    // temporary files of killed tasks that never reached their rename
+    error_code error;
+    for (const auto &entry : filesystem::directory_iterator(this->options.output_dir, error)) {
+        if (entry.path().filename().string().find(".tmp.") != string::npos) {
+            filesystem::remove(entry.path(), error);
+        }
+    }
+
+    for (int w = 0; w < int(this->workers.size()); w++) {
+        WorkerSlot &worker = this->workers[w];
+        worker.map.id = worker.reduce.id = w;
+        if (worker.map.tasks) this->stats->map.workers.push_back(worker.map);
+        if (worker.reduce.tasks) this->stats->reduce.workers.push_back(worker.reduce);
+    }
+    return !this->failed;
+}
+
+bool Coordinator::spawn() {
+    pid_t pid = fork();
+    if (pid < 0) {
+        cerr << "Could not spawn a worker: " << strerror(errno) << endl;
+        return false;
+    }
+    if (pid == 0) {
+        execl("/proc/self/exe", "mapreduce", "--worker", this->socket_path.c_str(), (char *) nullptr);
+        _exit(127);
+    }
+    this->children.push_back(pid);
+    return true;
+}
+
+void Coordinator::accept() {
+    int fd = ::accept4(this->listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    WorkerSlot worker;
+    worker.connection.reset(new Connection(fd));
+    worker.last_seen = chrono::steady_clock::now();
+    this->workers.push_back(move(worker));
+}
+
+void Coordinator::receive(int w) {
+    WorkerSlot &worker = this->workers[w];
+    if (worker.connection->fill() <= 0) {
+        this->fail(w, "disconnected");
+        return;
+    }
+
+    worker.last_seen = chrono::steady_clock::now();
+    Message message;
+    while (this->workers[w].alive && this->workers[w].connection->pop(message)) {
+        this->handle(w, message);
+    }
+}
+
+void Coordinator::handle(int w, Message &message) {
+    WorkerSlot &worker = this->workers[w];
+    switch (message.type()) {
+        case MSG_HELLO: {
+            uint64_t pid = 0;
+            message.get(pid);
+            if (find(this->children.begin(), this->children.end(), pid_t(pid)) != this->children.end()) {
+                worker.pid = pid;
+            }
+            if (!worker.connection->send(this->jobMessage())) {
+                this->fail(w, "could not send the job");
+                return;
+            }
+            worker.ready = true;
+            break;
+        }
+
+        case MSG_REQUEST:
+            worker.idle = true;
+            break;
+
+        case MSG_DONE: {
+            // the first copy of a task to finish completes it, a later copy only frees its worker
+            uint64_t index;
+            WorkerStats task_stats;
+            if (!message.get(index) || !getStats(message, task_stats)) {
+                this->fail(w, "sent a malformed report");
+                return;
+            }
+            if (int(index) == worker.task) {
+                Task &task = this->tasks[index];
+                task.workers.erase(remove(task.workers.begin(), task.workers.end(), w), task.workers.end());
+            }
+            if (int(index) == worker.task && this->tasks[index].state == TASK_RUNNING) {
+                this->tasks[index].state = TASK_DONE;
+                this->done++;
+
+                double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - worker.started).count();
+                this->durations[int(index) >= this->nmaps].push_back(elapsed);
+                if (worker.backup) {
+                    this->stats->backups_won++;
+                    cout << "Backup of " << this->taskName(index) << " on worker " << w << " finished first" << endl;
+                }
+
+                WorkerStats &total = int(index) < this->nmaps ? worker.map : worker.reduce;
+                total.wall_ms += task_stats.wall_ms;
+                total.cpu_ms += task_stats.cpu_ms;
+                total.tasks += task_stats.tasks;
+                total.bytes_read += task_stats.bytes_read;
+                total.bytes_written += task_stats.bytes_written;
+                total.records_in += task_stats.records_in;
+                total.records_out += task_stats.records_out;
+                total.keys += task_stats.keys;
+                total.spills += task_stats.spills;
+                total.partition_records.resize(task_stats.partition_records.size());
+                for (size_t i = 0; i < task_stats.partition_records.size(); i++) {
+                    total.partition_records[i] += task_stats.partition_records[i];
+                }
+            }
+            worker.task = -1;
+            worker.backup = false;
+            worker.idle = true;
+            break;
+        }
+
+        case MSG_HEARTBEAT:
+            break;
+
+        default:
+            this->fail(w, "sent an unexpected message");
+    }
+}
+
+void Coordinator::assign() {
+    for (int w = 0; w < int(this->workers.size()) && !this->failed; w++) {
+        WorkerSlot &worker = this->workers[w];
+        if (!worker.alive || !worker.ready || !worker.idle) continue;
+
+        // reduce tasks only start once every map task is done
+        int first = 0, last = this->nmaps;
+        if (this->done >= this->nmaps) {
+            first = this->nmaps;
+            last = this->tasks.size();
+        }
+        int index = first;
+        while (index < last && this->tasks[index].state != TASK_IDLE) index++;
+        bool backup = index == last;
+        if (backup) {
+            index = this->pickBackup(first, last);
+            if (index < 0) return;
+        }
+
+        Task &task = this->tasks[index];
+        if (++task.attempts > MAX_TASK_ATTEMPTS) {
+            cerr << "Task " << index << " failed " << MAX_TASK_ATTEMPTS << " times, aborting the job" << endl;
+            this->failed = true;
+            return;
+        }
+
+        Message message = index < this->nmaps ? Message(MSG_MAP).put(uint64_t(index)) : Message(MSG_REDUCE).put(uint64_t(index - this->nmaps));
+        if (!worker.connection->send(message)) {
+            task.attempts--;
+            this->fail(w, "could not send a task");
+            continue;
+        }
+        if (backup) {
+            this->stats->backups++;
+            cout << "Launching a backup of " << this->taskName(index) << " on worker " << w << endl;
+        }
+        task.state = TASK_RUNNING;
+        task.workers.push_back(w);
+        worker.task = index;
+        worker.backup = backup;
+        worker.started = chrono::steady_clock::now();
+        worker.idle = false;
+    }
+}
+
+int Coordinator::pickBackup(int first, int last) const {
+    if (!this->options.backup_tasks) return -1;
+
+    int remaining = 0;
+    for (int i = first; i < last; i++) {
+        if (this->tasks[i].state != TASK_DONE) remaining++;
+    }
+    if (remaining > max(1, int((last - first) * BACKUP_FRACTION))) return -1;
+
+    // without a completed task there is nothing to call slow
+    vector<double> durations = this->durations[first >= this->nmaps];
+    if (durations.empty()) return -1;
+    nth_element(durations.begin(), durations.begin() + durations.size() / 2, durations.end());
+    double threshold = durations[durations.size() / 2] * BACKUP_SLOWDOWN;
+
+    auto now = chrono::steady_clock::now();
+    int slowest = -1;
+    double longest = threshold;
+    for (int i = first; i < last; i++) {
+        const Task &task = this->tasks[i];
+        if (task.state != TASK_RUNNING || task.workers.size() != 1 || task.attempts >= MAX_TASK_ATTEMPTS) continue;
+        double elapsed = chrono::duration<double, milli>(now - this->workers[task.workers[0]].started).count();
+        if (elapsed > longest) {
+            slowest = i;
+            longest = elapsed;
+        }
+    }
+    return slowest;
+}
+
+void Coordinator::fail(int w, const string &reason) {
+    WorkerSlot &worker = this->workers[w];
+    if (!worker.alive) return;
+
+    worker.alive = false;
+    worker.connection->close();
+    if (worker.pid) kill(worker.pid, SIGKILL);
+
+    cerr << "Worker " << w;
+    if (worker.pid) cerr << " (pid " << worker.pid << ")";
+    cerr << " " << reason;
+    if (worker.task >= 0) {
+        Task &task = this->tasks[worker.task];
+        task.workers.erase(remove(task.workers.begin(), task.workers.end(), w), task.workers.end());
+        if (task.state == TASK_RUNNING && task.workers.empty()) {
+            task.state = TASK_IDLE;
+            cerr << ", re-executing " << this->taskName(worker.task);
+        } else if (task.state == TASK_RUNNING) {
+            cerr << ", " << this->taskName(worker.task) << " continues on worker " << task.workers[0];
+        }
+        worker.task = -1;
+    }
+    cerr << endl;
+}
+
+void Coordinator::checkHeartbeats() {
+    auto now = chrono::steady_clock::now();
+    auto timeout = chrono::milliseconds(this->options.worker_timeout);
+    for (int w = 0; w < int(this->workers.size()); w++) {
+        if (this->workers[w].alive && now - this->workers[w].last_seen > timeout) {
+            this->fail(w, "stopped sending heartbeats");
+        }
+    }
+}
+
+void Coordinator::superviseChildren() {
+    pid_t pid;
+    int status;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        this->children.erase(remove(this->children.begin(), this->children.end(), pid), this->children.end());
+        for (int w = 0; w < int(this->workers.size()); w++) {
+            if (this->workers[w].pid == pid) this->fail(w, "exited");
+        }
+    }
+
+    // keep nworkers processes running while tasks remain, within a bound on crash loops
+    int limit = this->options.nworkers * MAX_TASK_ATTEMPTS;
+    while (this->liveWorkers() < this->options.nworkers && this->respawns < limit) {
+        this->respawns++;
+        if (!this->spawn()) break;
+    }
+    if (this->liveWorkers() == 0) {
+        cerr << "No workers left, aborting the job" << endl;
+        this->failed = true;
+    }
+}
+
+int Coordinator::liveWorkers() const {
+    // spawned processes that have not connected yet count as live
+    int live = this->children.size();
+    for (const WorkerSlot &worker : this->workers) {
+        if (worker.alive && !worker.pid) live++;
+    }
+    return live;
+}
+
+string Coordinator::taskName(int index) const {
+    if (index < this->nmaps) return "map task " + to_string(index);
+    return "reduce task " + to_string(index - this->nmaps);
+}
+
+Message Coordinator::jobMessage() const {
+    Message message(MSG_JOB);
+    message.put(this->options.input_dir).put(this->options.output_dir);
+    message.put(uint64_t(this->options.nreduce)).put(uint64_t(this->options.job));
+    message.put(uint64_t(this->options.partition)).put(uint64_t(this->options.combine));
+    message.put(uint64_t(this->options.text_intermediate)).put(this->options.split_size);
+    message.put(this->options.memory_budget).put(uint64_t(this->options.dictionary)).put(uint64_t(this->options.compress));
+    message.put(this->options.top_k).put(uint64_t(this->options.incremental)).put(uint64_t(this->options.io)).put(uint64_t(this->options.approx));
+
+    message.put(this->files.size());
+    for (const string &file : this->files) {
+        message.put(file);
+    }
+    message.put(this->map_tasks.size());
+    for (const MapTask &task : this->map_tasks) {
+        message.put(uint64_t(task.file)).put(task.begin).put(task.end).put(uint64_t(task.cached));
+    }
+    message.put(this->splits.size());
+    for (const string &split : this->splits) {
+        message.put(split);
+    }
+    return message;
+}
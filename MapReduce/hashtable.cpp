@@ -0,0 +1,71 @@
+#include "headers.hpp"
+
+const size_t ARENA_BLOCK = 1 << 16;
+
+void Arena::grow(size_t need) {
+    size_t size = max(need, ARENA_BLOCK);
+    this->blocks.emplace_back(new char[size]);
+    this->next = this->blocks.back().get();
+    this->left = size;
+}
+
+void Arena::clear() {
+    this->blocks.clear();
+    this->next = nullptr;
+    this->left = 0;
+}
+
+CountTable::CountTable(size_t capacity) {
+    size_t size = 16;
+    while (size * 3 < capacity * 4) size <<= 1;
+    this->slots = vector<Slot>(size, Slot{0, nullptr, 0, 0});
+}
+
+size_t CountTable::size() const {
+    return this->used;
+}
+
+vector<pair<string_view, uint64_t>> CountTable::entries() const {
+    vector<pair<string_view, uint64_t>> entries;
+    entries.reserve(this->used);
+    this->forEach([&entries](string_view key, uint64_t count) {
+        entries.emplace_back(key, count);
+    });
+    return entries;
+}
+
+void CountTable::clear() {
+    fill(this->slots.begin(), this->slots.end(), Slot{0, nullptr, 0, 0});
+    this->used = 0;
+    this->arena.clear();
+}
+
+void CountTable::rehash() {
+    vector<Slot> old(this->slots.size() * 2, Slot{0, nullptr, 0, 0});
+    old.swap(this->slots);
+
+    // keys stay in the arena, only the slots move
+    size_t mask = this->slots.size() - 1;
+    for (const Slot &slot : old) {
+        if (!slot.hash) continue;
+        size_t i = (slot.hash >> 1) & mask;
+        while (this->slots[i].hash) i = (i + 1) & mask;
+        this->slots[i] = slot;
+    }
+}
+
+size_t KeyDictionary::size() const {
+    return this->ids.size();
+}
+
+vector<string_view> KeyDictionary::keys() const {
+    vector<string_view> keys(this->ids.size());
+    this->ids.forEach([&keys](string_view key, uint64_t id) {
+        keys[id] = key;
+    });
+    return keys;
+}
+
+void KeyDictionary::clear() {
+    this->ids.clear();
+}
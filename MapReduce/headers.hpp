@@ -2,8 +2,25 @@
 #define HEADERS
 
 #include "headers/libraries.hpp"
+#include "headers/hashtable.hpp"
+#include "headers/cache.hpp"
+#include "headers/codec.hpp"
+#include "headers/coordinator.hpp"
+#include "headers/input.hpp"
+#include "headers/io.hpp"
+#include "headers/job.hpp"
 #include "headers/master.hpp"
+#include "headers/partitioner.hpp"
+#include "headers/pool.hpp"
 #include "headers/mapper.hpp"
 #include "headers/reducer.hpp"
+#include "headers/rpc.hpp"
+#include "headers/runfile.hpp"
+#include "headers/scheduler.hpp"
+#include "headers/shuffle.hpp"
+#include "headers/sketch.hpp"
+#include "headers/stats.hpp"
+#include "headers/watch.hpp"
+#include "headers/worker.hpp"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,95 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include "libraries.hpp"
+#include "mapper.hpp"
+#include "options.hpp"
+
+/**
+ * @brief Fingerprint struct
+ * Identifies the contents of an input file between two runs.
+*/
+typedef struct Fingerprint {
+    uint64_t size = 0;      /**< size of the file in bytes */
+    int64_t mtime = 0;      /**< modification time in nanoseconds */
+    uint64_t hash = 0;      /**< hashKey of the whole file */
+} Fingerprint;
+
+/**
+ * @brief MapCache class
+ * Persistent map output of the input files, kept in _cache/<job> in
+ * the output directory so that a rerun over a mostly unchanged input
+ * only maps the files that changed. Every map task of a file leaves a
+ * run file with the combined counts of its split, named after the
+ * file's path and the split's byte range, and a manifest records the
+ * fingerprint (size, mtime and content hash) of every file whose runs
+ * are complete. A file is fresh when its path is in the manifest with
+ * the same fingerprint; the mappers then read its runs back instead of
+ * mapping it.
+ *
+ * The manifest only ever lists files whose runs were fully written:
+ * before the map phase it is rewritten without the stale files, and
+ * after the job with every file.
+*/
+class MapCache {
+    public:
+        /**
+         * @brief Construct a new MapCache object and load its manifest
+         *
+         * @param options the job options, the manifest is ignored with rebuild
+         * @return MapCache the new MapCache object
+        */
+        MapCache(const Options &options);
+
+        /**
+         * @brief Fingerprint an input file and compare it with the manifest
+         *
+         * @param path the input file
+         * @return true if the cached runs of the file can be reused
+        */
+        bool lookup(const string &path);
+
+        /**
+         * @brief Rewrite the manifest with only the fresh files, so that
+         *      runs overwritten by the map phase are never trusted if
+         *      the job does not finish
+         *
+         * @return true if the manifest was written
+        */
+        bool forgetStale();
+
+        /**
+         * @brief Record every looked up file in the manifest and remove
+         *      the runs that no task of this job uses
+         *
+         * @param runs the run files of every task of the job
+         * @return true if the manifest was written
+        */
+        bool commit(const vector<string> &runs);
+
+        /**
+         * @brief The cached run of a map task
+         *
+         * @param options the job options
+         * @param path the file of the task
+         * @param task the map task
+         * @return string the path of the run file
+        */
+        static string runFile(const Options &options, const string &path, const MapTask &task);
+
+    private:
+        string directory;                           /**< where the runs and the manifest live */
+        unordered_map<string, Fingerprint> saved;   /**< fingerprints of the last complete job */
+        unordered_map<string, Fingerprint> current; /**< fingerprints of the files of this job */
+        unordered_map<string, bool> fresh;          /**< whether each file of this job is unchanged */
+
+        /**
+         * @brief Write the fingerprints of the fresh files, or of every file
+         *
+         * @param all whether to include the stale files
+         * @return true if the manifest was written
+        */
+        bool writeManifest(bool all);
+};
+
+#endif // CACHE_HPP
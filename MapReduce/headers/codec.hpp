@@ -0,0 +1,144 @@
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include "libraries.hpp"
+
+/**
+ * Block compression of the intermediate and output files, an LZ77
+ * codec in the spirit of LZ4. A compressed block is a sequence of
+ *
+ *      token       literal length in the high nibble, match length
+ *                  minus 4 in the low nibble, 15 meaning more length
+ *                  bytes follow (each adds up to 255)
+ *      literals    the bytes copied as they are
+ *      offset      2 bytes, little endian, how far back the match starts
+ *
+ * and the last sequence of a block only has literals. Matches never
+ * reach outside their block, so every block decodes on its own.
+ *
+ * A compressed stream is a series of framed blocks, each a BlockHeader
+ * followed by the stored bytes. A block that does not shrink is stored
+ * as it is, with equal raw and stored sizes.
+*/
+
+/* level of --compress without --compress-level */
+const int COMPRESS_DEFAULT_LEVEL = 1;
+
+/* highest level, the slowest and smallest */
+const int COMPRESS_MAX_LEVEL = 9;
+
+/* raw bytes of a block cut from a larger buffer */
+const size_t COMPRESS_BLOCK = 1 << 16;
+
+typedef struct BlockHeader {
+    uint32_t raw;           /**< bytes of the block once decoded */
+    uint32_t stored;        /**< bytes that follow the header */
+} BlockHeader;
+
+/**
+ * @brief Compress one block
+ *      Level 1 looks for matches with one probe of a hash table and
+ *      skips ahead faster through bytes that do not compress; higher
+ *      levels follow hash chains 2^(level-1) deep and also index the
+ *      bytes inside matches.
+ *
+ * @param raw the bytes to compress, at most 4GB
+ * @param level the compression level, 1 to COMPRESS_MAX_LEVEL
+ * @return string the compressed block, without a BlockHeader
+*/
+string compressBlock(string_view raw, int level);
+
+/**
+ * @brief Decompress one block
+ *
+ * @param packed the compressed block
+ * @param raw the size of the block once decoded
+ * @param out the buffer to append the decoded bytes to
+ * @return true if the block decoded to exactly raw bytes
+*/
+bool decompressBlock(string_view packed, size_t raw, string &out);
+
+/**
+ * @brief Append a framed block, compressed unless that does not shrink it
+ *
+ * @param out the stream to append to
+ * @param raw the bytes of the block
+ * @param level the compression level
+*/
+void appendBlock(string &out, string_view raw, int level);
+
+/**
+ * @brief Decode the stored bytes of a framed block
+ *
+ * @param header the header of the block
+ * @param stored the bytes that followed the header
+ * @param out the buffer to append the decoded bytes to
+ * @return true if the block was valid
+*/
+bool decodeBlock(const BlockHeader &header, string_view stored, string &out);
+
+/**
+ * @brief Compress a buffer as framed blocks of COMPRESS_BLOCK bytes
+ *
+ * @param raw the bytes to compress
+ * @param level the compression level
+ * @return string the framed blocks
+*/
+string compressBlocks(string_view raw, int level);
+
+/**
+ * @brief Decode a series of framed blocks
+ *
+ * @param blocks the framed blocks
+ * @param out the buffer to append the decoded bytes to
+ * @return true if every block was valid and complete
+*/
+bool decompressBlocks(string_view blocks, string &out);
+
+/**
+ * @brief BlockReader class
+ * Reads a file of framed blocks one decoded block at a time, so a
+ * compressed file is streamed through a buffer of one block.
+*/
+class BlockReader {
+    public:
+        /**
+         * @brief Open a file of framed blocks
+         *
+         * @param filename the file to read
+         * @return BlockReader the new BlockReader object
+        */
+        BlockReader(const string &filename);
+
+        /**
+         * @brief Close the file
+        */
+        ~BlockReader();
+
+        BlockReader(const BlockReader &) = delete;
+        BlockReader &operator=(const BlockReader &) = delete;
+
+        /**
+         * @brief Decode the next block
+         *
+         * @param block set to the decoded block, valid until the next call
+         * @return true if a block was decoded
+         * @return false at the end of the file or if it is corrupt
+        */
+        bool next(string_view &block);
+
+        /**
+         * @brief The size of the file in bytes
+        */
+        uint64_t size() const;
+
+    private:
+        string name;            /**< the file, for error messages */
+        int fd = -1;            /**< the open file */
+        uint64_t offset = 0;    /**< where the next block header is */
+        uint64_t end = 0;       /**< the size of the file */
+        string stored;          /**< stored bytes of the current block */
+        string decoded;         /**< the current block */
+};
+
+#endif // CODEC_HPP
@@ -0,0 +1,181 @@
+#ifndef COORDINATOR_HPP
+#define COORDINATOR_HPP
+
+#include "libraries.hpp"
+#include "mapper.hpp"
+#include "options.hpp"
+#include "partitioner.hpp"
+#include "rpc.hpp"
+#include "stats.hpp"
+
+/**
+ * @brief Coordinator class
+ * Runs the map and reduce tasks of a job on separate worker processes.
+ * The Coordinator listens on a Unix-domain socket, spawns nworkers
+ * copies of this executable in worker mode (more workers may connect
+ * with ./mapreduce --worker <socket>) and hands a task to every worker
+ * that asks for one, reduce tasks once every map task is done.
+ *
+ * As in the MapReduce paper, a worker that disconnects or stops sending
+ * heartbeats is declared failed: a spawned worker is killed and replaced,
+ * and the task it was running goes back to the idle tasks to be executed
+ * again by another worker. All map output lives in the shared output
+ * directory, so completed tasks of a failed worker are not re-executed.
+ * A task that fails too many times aborts the job.
+ *
+ * Near the end of each phase, when workers would otherwise sit idle,
+ * the slowest running task gets a backup execution on an idle worker
+ * and whichever copy finishes first completes the task. Every task
+ * commits its files with an atomic rename, so the copy that loses
+ * rewrites identical files without ever exposing a partial one.
+*/
+class Coordinator {
+    public:
+        /**
+         * @brief Construct a new Coordinator object
+         *
+         * @param options the job options
+         * @param files the input files
+         * @param tasks the map tasks over the files
+         * @param splits the split points of a range partitioner
+         * @param stats where the phase and worker stats are recorded
+         * @return Coordinator the new Coordinator object
+        */
+        Coordinator(const Options &options,
+                const vector<string> &files,
+                const vector<MapTask> &tasks,
+                const vector<string> &splits,
+                JobStats *stats
+        );
+
+        /**
+         * @brief Kill the workers that are still running and remove the socket
+        */
+        ~Coordinator();
+
+        /**
+         * @brief Run every map task and then every reduce task
+         *
+         * @return true if every task completed
+        */
+        bool run();
+
+    private:
+        typedef enum {TASK_IDLE, TASK_RUNNING, TASK_DONE} TaskState;
+
+        typedef struct Task {
+            TaskState state = TASK_IDLE;    /**< progress of the task */
+            vector<int> workers;            /**< workers running a copy of the task */
+            int attempts = 0;               /**< times the task was assigned */
+        } Task;
+
+        typedef struct WorkerSlot {
+            unique_ptr<Connection> connection;  /**< socket to the worker */
+            pid_t pid = 0;                  /**< process id, 0 if not spawned here */
+            bool alive = true;              /**< not failed or exited */
+            bool ready = false;             /**< received the job */
+            bool idle = false;              /**< waiting for a task */
+            int task = -1;                  /**< task being run, -1 for none */
+            bool backup = false;            /**< the task is a backup copy */
+            chrono::steady_clock::time_point started;   /**< when the task was assigned */
+            chrono::steady_clock::time_point last_seen; /**< time of the last message */
+            WorkerStats map;                /**< summed stats of its map tasks */
+            WorkerStats reduce;             /**< summed stats of its reduce tasks */
+        } WorkerSlot;
+
+        const Options &options;             /**< the job options */
+        const vector<string> &files;        /**< the input files */
+        const vector<MapTask> &map_tasks;   /**< the map tasks over the files */
+        const vector<string> &splits;       /**< split points of a range partitioner */
+        JobStats *stats;                    /**< the job stats */
+        string socket_path;                 /**< where the workers connect */
+        int listener = -1;                  /**< the listening socket */
+        vector<Task> tasks;                 /**< map tasks, then one task per partition */
+        int nmaps;                          /**< the number of map tasks */
+        int done = 0;                       /**< tasks completed */
+        vector<double> durations[2];        /**< milliseconds taken by completed map and reduce tasks */
+        vector<WorkerSlot> workers;         /**< every worker that connected */
+        vector<pid_t> children;             /**< spawned processes not reaped yet */
+        int respawns = 0;                   /**< workers spawned to replace failed ones */
+        bool failed = false;                /**< a task failed too many times */
+
+        /**
+         * @brief Start a worker process that connects back to the socket
+         *
+         * @return true if the process was started
+        */
+        bool spawn();
+
+        /**
+         * @brief Accept a worker connection
+        */
+        void accept();
+
+        /**
+         * @brief Read a worker's socket and handle its complete messages
+         *
+         * @param w the worker slot
+        */
+        void receive(int w);
+
+        /**
+         * @brief Handle a message from a worker
+         *
+         * @param w the worker slot
+         * @param message the message
+        */
+        void handle(int w, Message &message);
+
+        /**
+         * @brief Give a task to every idle worker while tasks are available
+        */
+        void assign();
+
+        /**
+         * @brief Pick a straggler to back up once a phase is nearly done
+         *      Only tasks with a single running copy that has taken longer
+         *      than BACKUP_SLOWDOWN times the median completed task of the
+         *      phase qualify, and the one running longest is picked.
+         *
+         * @param first the first task of the phase
+         * @param last one past the last task of the phase
+         * @return int the task to back up, -1 for none
+        */
+        int pickBackup(int first, int last) const;
+
+        /**
+         * @brief Declare a worker failed and put its running task back
+         *      unless a backup copy of it is still running
+         *
+         * @param w the worker slot
+         * @param reason why the worker failed
+        */
+        void fail(int w, const string &reason);
+
+        /**
+         * @brief Fail the workers whose last message is older than the timeout
+        */
+        void checkHeartbeats();
+
+        /**
+         * @brief Reap exited worker processes and replace failed ones
+        */
+        void superviseChildren();
+
+        /**
+         * @brief The number of spawned or connected workers still running
+        */
+        int liveWorkers() const;
+
+        /**
+         * @brief Name a task for the log, for example "map task 3"
+        */
+        string taskName(int index) const;
+
+        /**
+         * @brief Encode the options, files, tasks and splits of the job
+        */
+        Message jobMessage() const;
+};
+
+#endif // COORDINATOR_HPP
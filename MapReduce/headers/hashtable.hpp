@@ -0,0 +1,224 @@
+#ifndef HASHTABLE_HPP
+#define HASHTABLE_HPP
+
+#include "libraries.hpp"
+
+/**
+ * @brief Hash a key with a multiply-mix over 8-byte words
+ *
+ * @param key the key to hash
+ * @return uint64_t the 64-bit hash
+*/
+inline uint64_t hashKey(string_view key) {
+    const uint64_t P0 = 0xa0761d6478bd642fULL;
+    const uint64_t P1 = 0xe7037ed1a0b428dbULL;
+    auto mix = [](uint64_t a, uint64_t b) {
+        __uint128_t r = (__uint128_t) a * b;
+        return uint64_t(r) ^ uint64_t(r >> 64);
+    };
+
+    const char *p = key.data();
+    size_t n = key.size();
+    uint64_t h = P0 ^ n;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = mix(h ^ w, P1);
+    }
+    uint64_t w = 0;
+    memcpy(&w, p, n);
+    return mix(mix(h ^ w, P1), P0);
+}
+
+/**
+ * @brief Arena class
+ * Bump-pointer allocator for keys. Memory is only released all at
+ * once, when the arena is cleared or destroyed.
+*/
+class Arena {
+    public:
+        Arena() = default;
+        Arena(Arena &&) = default;
+        Arena &operator=(Arena &&) = default;
+
+        /**
+         * @brief Copy a key into the arena
+         *
+         * @param key the bytes to copy
+         * @return const char* the stable copy
+        */
+        const char *store(string_view key) {
+            if (key.size() > this->left || !this->next) this->grow(key.size());
+            char *copy = this->next;
+            memcpy(copy, key.data(), key.size());
+            this->next += key.size();
+            this->left -= key.size();
+            return copy;
+        }
+
+        /**
+         * @brief Release every block
+        */
+        void clear();
+
+    private:
+        vector<unique_ptr<char[]>> blocks;  /**< allocated blocks */
+        char *next = nullptr;               /**< next free byte */
+        size_t left = 0;                    /**< free bytes in the current block */
+
+        /**
+         * @brief Start a new block big enough for a key
+         *
+         * @param need the size of the key
+        */
+        void grow(size_t need);
+};
+
+/**
+ * @brief CountTable class
+ * Open-addressing hash table from string keys to counts using linear
+ * probing. Each slot caches the full hash of its key so probes only
+ * compare key bytes on a hash match, and keys are stored in an Arena.
+*/
+class CountTable {
+    public:
+        typedef struct Slot {
+            uint64_t hash;      /**< cached hash, 0 marks an empty slot */
+            const char *key;    /**< key bytes in the arena */
+            uint32_t length;    /**< key length */
+            uint64_t count;     /**< summed value */
+        } Slot;
+
+        /**
+         * @brief Construct a new CountTable object
+         *
+         * @param capacity the expected number of distinct keys
+        */
+        CountTable(size_t capacity = 1024);
+
+        /**
+         * @brief Fold a value into a key, inserting it if missing
+         *
+         * @param key the key
+         * @param value the value to fold in
+         * @param combine called as combine(uint64_t &acc, uint64_t value)
+         *      when the key is already present
+        */
+        template <typename Combine>
+        void add(string_view key, uint64_t value, Combine &&combine) {
+            // the low bit marks the slot as used, so the probe starts from the others
+            uint64_t hash = hashKey(key) | 1;
+            size_t mask = this->slots.size() - 1;
+            for (size_t i = (hash >> 1) & mask; ; i = (i + 1) & mask) {
+                Slot &slot = this->slots[i];
+                if (slot.hash == hash &&
+                    slot.length == key.size() &&
+                    memcmp(slot.key, key.data(), key.size()) == 0
+                ) {
+                    combine(slot.count, value);
+                    return;
+                }
+                if (slot.hash == 0) {
+                    slot = Slot{hash, this->arena.store(key), uint32_t(key.size()), value};
+                    if (++this->used * 4 > this->slots.size() * 3) this->rehash();
+                    return;
+                }
+            }
+        }
+
+        /**
+         * @brief Add a count to a key, inserting it if missing
+         *
+         * @param key the key
+         * @param count the value to add
+        */
+        void add(string_view key, uint64_t count) {
+            this->add(key, count, [](uint64_t &acc, uint64_t value) {
+                acc += value;
+            });
+        }
+
+        /**
+         * @brief The number of distinct keys
+        */
+        size_t size() const;
+
+        /**
+         * @brief Call a function on every key and count, in slot order
+         *
+         * @param f called as f(string_view key, uint64_t count)
+        */
+        template <typename F>
+        void forEach(F &&f) const {
+            for (const Slot &slot : this->slots) {
+                if (slot.hash) f(string_view(slot.key, slot.length), slot.count);
+            }
+        }
+
+        /**
+         * @brief Collect the entries so they can be sorted once at output time
+         *
+         * @return vector<pair<string_view, uint64_t>> the unsorted entries
+        */
+        vector<pair<string_view, uint64_t>> entries() const;
+
+        /**
+         * @brief Remove every key and free the arena
+        */
+        void clear();
+
+    private:
+        vector<Slot> slots;     /**< power-of-two slot array */
+        size_t used = 0;        /**< number of occupied slots */
+        Arena arena;            /**< storage for the keys */
+
+        /**
+         * @brief Double the slot array and reinsert every key
+        */
+        void rehash();
+};
+
+/**
+ * @brief KeyDictionary class
+ * Numbers distinct keys from 0 in the order they are first seen, for
+ * the dictionary-encoded intermediate format. Each key is stored once,
+ * in the arena of a CountTable whose counts hold the ids.
+*/
+class KeyDictionary {
+    public:
+        /**
+         * @brief The id of a key, numbering it if it is new
+         *
+         * @param key the key
+         * @return uint64_t the id of the key
+        */
+        uint64_t id(string_view key) {
+            uint64_t found = this->ids.size();
+            this->ids.add(key, found, [&found](uint64_t &id, uint64_t) {
+                found = id;
+            });
+            return found;
+        }
+
+        /**
+         * @brief The number of distinct keys
+        */
+        size_t size() const;
+
+        /**
+         * @brief Every key, indexed by its id
+         *
+         * @return vector<string_view> the keys, valid until clear
+        */
+        vector<string_view> keys() const;
+
+        /**
+         * @brief Remove every key, ids start again from 0
+        */
+        void clear();
+
+    private:
+        CountTable ids;     /**< the id of every key */
+};
+
+#endif // HASHTABLE_HPP
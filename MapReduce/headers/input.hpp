@@ -0,0 +1,70 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include "libraries.hpp"
+
+/**
+ * @brief InputFile class
+ * The InputFile class exposes the contents of an input file as a
+ * read-only byte range. The file is memory-mapped when possible so
+ * that the Mapper can tokenize it in place; files that cannot be
+ * mapped (empty files, pipes, special files) are read into a single
+ * buffer instead.
+*/
+class InputFile {
+    public:
+        /**
+         * @brief Open and map an input file
+         *
+         * @param path the path of the file to open
+         * @return InputFile the new InputFile object
+        */
+        InputFile(const string &path);
+
+        /**
+         * @brief Unmap the file
+        */
+        ~InputFile();
+
+        InputFile(const InputFile &) = delete;
+        InputFile &operator=(const InputFile &) = delete;
+
+        /**
+         * @brief The contents of the file
+         *
+         * @return string_view the bytes of the file
+        */
+        string_view data() const;
+
+        /**
+         * @brief Check if the file is memory-mapped
+         *
+         * @return true if the file is mapped
+         * @return false if the file was read into a buffer
+        */
+        bool isMapped() const;
+
+    private:
+        const char *bytes;  /**< start of the file contents */
+        size_t length;      /**< size of the file contents */
+        bool mapped;        /**< whether bytes points into a mapping */
+        string buffer;      /**< fallback buffer for unmappable files */
+
+        /**
+         * @brief Map the file into memory for sequential access
+         *
+         * @param fd the open file descriptor
+         * @param size the size of the file
+         * @return true if the file was mapped
+        */
+        bool mapFile(int fd, size_t size);
+
+        /**
+         * @brief Read the whole file into the fallback buffer
+         *
+         * @param fd the open file descriptor
+        */
+        void readFile(int fd);
+};
+
+#endif // INPUT_HPP
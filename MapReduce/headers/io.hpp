@@ -0,0 +1,206 @@
+#ifndef IO_HPP
+#define IO_HPP
+
+#include "libraries.hpp"
+#include "options.hpp"
+
+/* bytes of one input read */
+const size_t IO_CHUNK = 1 << 20;
+
+/* input reads kept in flight ahead of the tokenizer */
+const size_t IO_DEPTH = 4;
+
+/* free bytes before each read buffer, where a caller may move the
+   partial record left over from the previous chunk */
+const size_t IO_HEADROOM = 1 << 16;
+
+/**
+ * @brief IoEngine class
+ * Asynchronous file I/O for one mapper thread. Input is streamed in
+ * chunks of IO_CHUNK bytes with IO_DEPTH reads in flight, so the disk
+ * fills the next buffers while the current one is tokenized, and writes
+ * are queued so that the next partition is encoded while the previous
+ * one is written.
+ *
+ * With IO_URING the reads and writes go through an io_uring submission
+ * queue, set up with raw system calls. The IO_DEPTH read buffers and
+ * IO_DEPTH write buffers of IO_CHUNK bytes are registered with the ring,
+ * so reads are IORING_OP_READ_FIXED and a queued write is copied into a
+ * free write buffer, IO_CHUNK bytes at a time, and submitted as
+ * IORING_OP_WRITE_FIXED. When the buffers cannot be registered (they
+ * count against RLIMIT_MEMLOCK), the same buffers are used with plain
+ * reads and writes. When the kernel refuses io_uring, and with
+ * IO_PREAD, reads are synchronous preads of the current chunk while
+ * POSIX_FADV_WILLNEED readahead keeps the next ones in flight, and
+ * writes are synchronous pwrites. If io_uring_enter fails for good, the
+ * reads and writes queued from then on are done with pread and pwrite
+ * when the engine would have waited for them.
+*/
+class IoEngine {
+    public:
+        /**
+         * @brief Construct a new IoEngine object and set up its ring
+         *
+         * @param mode IO_URING, or IO_PREAD for the fallback
+         * @return IoEngine the new IoEngine object
+        */
+        IoEngine(IoMode mode);
+
+        /**
+         * @brief Wait for the I/O in flight and tear the ring down
+        */
+        ~IoEngine();
+
+        IoEngine(const IoEngine &) = delete;
+        IoEngine &operator=(const IoEngine &) = delete;
+
+        /**
+         * @brief Check if the engine runs on io_uring
+        */
+        bool uring() const;
+
+        /**
+         * @brief Start reading a byte range of a file ahead of next
+         *
+         * @param path the file to read
+         * @param begin the first byte to read
+         * @param end one past the last byte to read
+         * @return true if the file was opened
+        */
+        bool open(const string &path, uint64_t begin, uint64_t end);
+
+        /**
+         * @brief Wait for the next chunk of the range, in file order
+         *      The IO_HEADROOM bytes before data are free for the
+         *      caller, and the buffer is read into again once next is
+         *      called again
+         *
+         * @param data set to the first byte of the chunk
+         * @param length set to the bytes of the chunk
+         * @return true if a chunk was read
+         * @return false at the end of the range or on a read error
+        */
+        bool next(char *&data, size_t &length);
+
+        /**
+         * @brief Queue a write, copying the bytes into the write buffers
+         *      and waiting for a free buffer while they are all in flight
+         *      The bytes can be freed once write returns
+         *
+         * @param fd the file to write, open until drain
+         * @param offset where to write
+         * @param bytes the bytes to write
+         * @param ok set to false if the write fails, valid until drain
+        */
+        void write(int fd, uint64_t offset, string_view bytes, bool *ok);
+
+        /**
+         * @brief Wait for every queued write
+        */
+        void drain();
+
+    private:
+        typedef struct ReadBuffer {
+            char *data;             /**< where the chunk is read to */
+            uint64_t offset;        /**< file offset of the chunk */
+            size_t length;          /**< bytes asked for */
+            int64_t result;         /**< bytes read or -errno, once done */
+            bool done;              /**< the read completed */
+        } ReadBuffer;
+
+        typedef struct WriteSlot {
+            char *data;             /**< the write buffer */
+            int fd;                 /**< the file */
+            uint64_t offset;        /**< where the buffer goes in the file */
+            size_t length;          /**< bytes in the buffer */
+            size_t written;         /**< bytes written so far */
+            bool *ok;               /**< cleared on failure */
+        } WriteSlot;
+
+        int ring = -1;              /**< the io_uring, -1 for the fallback */
+        unsigned entries = 0;       /**< submission queue entries */
+        unsigned inflight = 0;      /**< submitted and not completed */
+        unsigned pending = 0;       /**< filled entries not submitted yet */
+        void *sq_ring = nullptr;    /**< mapped submission ring */
+        void *cq_ring = nullptr;    /**< mapped completion ring, may be sq_ring */
+        size_t sq_size = 0;         /**< bytes of the sq_ring mapping */
+        size_t cq_size = 0;         /**< bytes of the cq_ring mapping */
+        void *sqes = nullptr;       /**< mapped submission queue entries */
+        unsigned *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+        unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+        void *cqes = nullptr;       /**< the completion queue entries */
+        bool registered = false;    /**< the read and write buffers are registered */
+        bool failed = false;        /**< io_uring_enter failed, queued I/O is done synchronously */
+
+        vector<char> storage;       /**< IO_DEPTH read buffers with their headroom,
+                                         then IO_DEPTH write buffers */
+        vector<char> retired;       /**< the storage the kernel knew, once the ring failed */
+        vector<ReadBuffer> buffers; /**< state of each read buffer */
+        deque<int> order;           /**< buffers with reads submitted, in file order */
+        int current = -1;           /**< buffer handed out by next */
+        int fd = -1;                /**< the input file */
+        string path;                /**< the input file, for error messages */
+        uint64_t cursor = 0;        /**< next offset to read */
+        uint64_t end = 0;           /**< end of the range */
+        vector<WriteSlot> writes;   /**< state of each write buffer */
+        vector<int> idle;           /**< write buffers not in flight */
+
+        /**
+         * @brief Set up the ring and register the read and write buffers
+         *
+         * @return true if io_uring is usable
+        */
+        bool setup();
+
+        /**
+         * @brief Submit a read of the next chunk of the range into a buffer
+         *
+         * @param i the buffer
+        */
+        void submitRead(int i);
+
+        /**
+         * @brief Submit the unwritten part of a write buffer
+         *
+         * @param i the write buffer
+        */
+        void submitWrite(int i);
+
+        /**
+         * @brief Take a free submission queue entry, waiting for
+         *      completions while the ring is full
+        */
+        void *entry();
+
+        /**
+         * @brief Submit the filled entries and handle the completions
+         *
+         * @param wait the completions to wait for, 0 to only submit
+        */
+        void enter(unsigned wait);
+
+        /**
+         * @brief Give up the ring: move the buffers to new storage, since
+         *      the kernel may still complete the requests it took into
+         *      the old one, and do the rest synchronously
+        */
+        void fail();
+
+        /**
+         * @brief Do the reads and writes in flight with pread and pwrite,
+         *      once the ring failed
+        */
+        void finish();
+
+        /**
+         * @brief Handle one completion
+        */
+        void complete(uint64_t tag, int32_t result);
+
+        /**
+         * @brief Wait until every read in flight completed
+        */
+        void settle();
+};
+
+#endif // IO_HPP
@@ -0,0 +1,127 @@
+#ifndef JOB_HPP
+#define JOB_HPP
+
+#include "libraries.hpp"
+#include "tokenizer.hpp"
+
+/**
+ * @brief Job struct
+ * Compile-time description of a map reduce job. The Mapper and the
+ * Reducer are templated on a Job, so its functors are called directly,
+ * and inlined, for every record without any virtual dispatch.
+ *
+ *      Map         map(split, emit) calls emit(key, value) for every
+ *                  record of an input split, and the static
+ *                  Map::align(file, begin, end) moves a split's byte
+ *                  range to record boundaries, and the static
+ *                  Map::complete(text) finds where the last whole
+ *                  record of a streamed chunk ends
+ *      Combine     combine(acc, value) folds a value into the partial
+ *                  value of its key inside a mapper
+ *      Reduce      reduce(acc, value) folds a value into the final value
+ *                  of its key inside a reducer
+ *
+ * Keys are carried as bytes and values as varints in the intermediate
+ * runs, which the static asserts enforce.
+*/
+template <typename K, typename V, typename MapFn, typename CombineFn, typename ReduceFn>
+struct Job {
+    static_assert(is_convertible_v<K, string_view>, "job keys are stored as bytes");
+    static_assert(is_unsigned_v<V>, "job values are encoded as varints");
+
+    typedef K Key;
+    typedef V Value;
+    typedef MapFn Map;
+    typedef CombineFn Combine;
+    typedef ReduceFn Reduce;
+};
+
+/**
+ * @brief Sum functor, the combine and reduce step of counting jobs
+*/
+struct Sum {
+    template <typename V>
+    void operator()(V &acc, V value) const {
+        acc += value;
+    }
+};
+
+/**
+ * @brief WordCountMap functor
+ * Emits (word, 1) for every word of a split.
+*/
+struct WordCountMap {
+    Tokenizer tokenizer;    /**< splits the input into words */
+
+    template <typename Emit>
+    void operator()(string_view split, Emit &&emit) {
+        this->tokenizer.tokenize(split, [&emit](string_view word) {
+            emit(word, uint64_t(1));
+        });
+    }
+
+    static string_view align(string_view text, size_t begin, size_t end) {
+        return Tokenizer::align(text, begin, end);
+    }
+
+    static size_t complete(string_view text) {
+        size_t last = text.find_last_of(" \n");
+        return last == string_view::npos ? 0 : last + 1;
+    }
+};
+
+/**
+ * @brief NGramMap functor
+ * Emits ("w1 ... wN", 1) for every N consecutive non-empty words of a
+ * line, so splits are aligned to line boundaries.
+*/
+template <int N>
+struct NGramMap {
+    Tokenizer tokenizer;    /**< splits a line into words */
+    string window[N];       /**< the last N words, as a ring */
+    string gram;            /**< the joined n-gram being emitted */
+
+    template <typename Emit>
+    void operator()(string_view split, Emit &&emit) {
+        size_t start = 0;
+        while (start < split.size()) {
+            size_t end = split.find('\n', start);
+            if (end == string_view::npos) end = split.size();
+
+            size_t seen = 0;
+            this->tokenizer.tokenize(split.substr(start, end - start), [&](string_view word) {
+                if (word.empty()) return;
+                this->window[seen++ % N].assign(word);
+                if (seen < N) return;
+
+                this->gram.clear();
+                for (size_t i = seen - N; i < seen; i++) {
+                    if (i > seen - N) this->gram.push_back(' ');
+                    this->gram.append(this->window[i % N]);
+                }
+                emit(string_view(this->gram), uint64_t(1));
+            });
+            start = end + 1;
+        }
+    }
+
+    static string_view align(string_view text, size_t begin, size_t end) {
+        auto cut = [&text](size_t p) {
+            while (p < text.size() && text[p - 1] != '\n') p++;
+            return min(p, text.size());
+        };
+        size_t from = begin == 0 ? 0 : cut(begin);
+        size_t to = end >= text.size() ? text.size() : cut(end);
+        return from < to ? text.substr(from, to - from) : string_view();
+    }
+
+    static size_t complete(string_view text) {
+        size_t last = text.rfind('\n');
+        return last == string_view::npos ? 0 : last + 1;
+    }
+};
+
+typedef Job<string_view, uint64_t, WordCountMap, Sum, Sum> WordCount;
+typedef Job<string_view, uint64_t, NGramMap<2>, Sum, Sum> Bigrams;
+
+#endif // JOB_HPP
@@ -10,6 +10,26 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <queue>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <charconv>
+#include <chrono>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
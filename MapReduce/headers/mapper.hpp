@@ -2,33 +2,61 @@
 #define MAPPER_HPP
 
 #include "libraries.hpp"
+#include "hashtable.hpp"
+#include "job.hpp"
+#include "options.hpp"
+#include "partitioner.hpp"
+#include "runfile.hpp"
+#include "scheduler.hpp"
+#include "shuffle.hpp"
+#include "sketch.hpp"
+#include "stats.hpp"
+
+/**
+ * @brief MapTask struct
+ * A byte range of an input file to map. Ranges are aligned to record
+ * boundaries by the job's Map::align, see Tokenizer::align.
+*/
+typedef struct MapTask {
+    int file;           /**< index of the file in the input file list */
+    uint64_t begin;     /**< first byte of the split */
+    uint64_t end;       /**< one past the last byte of the split */
+    bool cached = false;    /**< the split's counts are in the map cache */
+} MapTask;
 
 /**
  * @brief Mapper class
- * The Mapper class is responsible for processing the input
- * files and creating partition files for each reduce worker.
+ * The Mapper class is responsible for processing the map tasks
+ * it pulls from the TaskScheduler with the map function of a Job
+ * and creating partition files for each reduce worker.
+ *
+ * With approx, the records of each partition only update an
+ * ApproxSketch of fixed size, which is written instead of the records.
+ *
+ * @tparam Job the job to run, see job.hpp
 */
+template <typename Job>
 class Mapper {
     public:
         /**
          * @brief Construct a new Mapper object
          *
          * @param id the worker id
-         * @param input_dir the input directory
-         * @param output_dir the output directory
-         * @param start the first file index to process
-         * @param end the last file index to process
-         * @param nreduce the number of reduce partitions
+         * @param options the job options
          * @param files the list of files in the input_dir to process
+         * @param tasks the map tasks over the files
+         * @param scheduler the scheduler handing out task indices
+         * @param partitioner assigns keys to reduce partitions
+         * @param shuffle the in-memory shuffle, or nullptr to write files
          * @return Mapper the new Mapper object
         */
         Mapper(int id,
-                string input,
-                string output,
-                int start,
-                int end,
-                int nreduce,
-                vector<string> *files
+                const Options *options,
+                vector<string> *files,
+                vector<MapTask> *tasks,
+                TaskScheduler *scheduler,
+                const Partitioner *partitioner,
+                Shuffle *shuffle
         );
 
         /**
@@ -36,53 +64,194 @@ class Mapper {
         */
         void map();
 
+        /**
+         * @brief Map a single task and write its partition files, used by
+         *      worker processes that get their tasks from the master
+         *
+         * @param task the index of the task, also used as the worker id
+         *      in the names of the partition files
+        */
+        void mapTask(int task);
+
+        /**
+         * @brief What the mapper did, once map returned
+        */
+        const WorkerStats &getStats() const;
+
     private:
         int worker_id;              /**< worker id */
-        string input_dir;           /**< input directory */
-        string output_dir;          /**< output directory */
+        const Options *options;     /**< job options */
         int nreduce;                /**< number of reduce partitions */
-        int start_file;             /**< first file index to process */
-        int end_file;               /**< last file index to process */
         vector<string> *files;      /**< files in the input_dir to process */
-        vector<string> partitions;  /**< partition strings for each reducer */
+        vector<MapTask> *tasks;     /**< map tasks over the files */
+        TaskScheduler *scheduler;   /**< source of task indices to map */
+        const Partitioner *partitioner; /**< assigns keys to reduce partitions */
+        Shuffle *shuffle;           /**< in-memory shuffle, nullptr for files */
+        int level;                  /**< compression level of the runs, 0 for none */
+        vector<string> partitions;  /**< partition strings for each reducer,
+                                         key,value lines in text mode,
+                                         unsorted run records in run mode or
+                                         key id and value records with a dictionary */
+        vector<CountTable> combined;    /**< per-partition values when combining */
+        vector<KeyDictionary> dictionaries; /**< per-partition key ids of dictionary runs */
+        vector<uint64_t> encoded;       /**< records in each partition of dictionary runs */
+        vector<ApproxSketch> sketches;  /**< per-partition sketches with approx */
+        typename Job::Map map_fn;           /**< the job's map functor */
+        typename Job::Combine combine_fn;   /**< the job's combine functor */
+        WorkerStats stats;                  /**< counters for the job report */
+        uint64_t buffered = 0;              /**< bytes held for the partitions,
+                                                 counted against the memory budget */
+        vector<unique_ptr<AtomicFile>> spills;  /**< map.part files holding spilled runs */
+        vector<unique_ptr<AtomicFile>> outputs; /**< map.part files written, not committed yet */
+        unique_ptr<IoEngine> io;            /**< streams the input and queues the writes,
+                                                 nullptr to map the input */
+
+        /**
+         * @brief Map one split into the partitions
+         *
+         * @param task the index of the task
+        */
+        void mapSplit(int task);
 
         /**
-         * @brief Split a string by a delimiter
+         * @brief Emit the cached combined counts of a split of an
+         *      unchanged file instead of mapping it
          *
-         * @param line the string to split
-         * @param delimiter the delimiter to split by
-         * @return vector<string> the split string
+         * @param task the map task
+         * @return true if the cached run was read, false to map the split
         */
-        vector<string> split(string line, char delimiter);
+        bool replaySplit(const MapTask &task);
 
         /**
-         * @brief Create partition files for each reduce partition
+         * @brief Run the map functor over a split, in place in the mapped
+         *      file or over chunks streamed by the I/O engine, cut after
+         *      their last whole record
+         *
+         * @param task the map task
+         * @param emit called as emit(key, value) for every record
+        */
+        template <typename Emit>
+        void readSplit(const MapTask &task, Emit &&emit);
+
+        /**
+         * @brief Store the combined counts of a split in the map cache
+         *      and emit them
+         *
+         * @param task the map task
+         * @param counts the combined counts of the split
+        */
+        void cacheSplit(const MapTask &task, CountTable &counts);
+
+        /**
+         * @brief Write the partitions, close the shuffle and record the stats
+         *
+         * @param watch started when the mapper started
+        */
+        void finish(const Stopwatch &watch);
+
+        /**
+         * @brief Create partition files for each reduce partition, or hand
+         *      the encoded partitions to the in-memory shuffle
         */
         void createPartitionFiles();
 
         /**
-         * @brief Hash a key (word) to a reduce partition
+         * @brief Append a block to a map.part file, through the I/O engine
+         *      when there is one
          *
-         * @param key the key to partition
-         * @return int the reduce partition number
+         * @param file the file
+         * @param block the encoded block
+        */
+        void writeTo(AtomicFile &file, string_view block);
+
+        /**
+         * @brief Wait for the queued writes and commit map.part files
+         *
+         * @param files the files of every partition, cleared once committed
+        */
+        void commitFiles(vector<unique_ptr<AtomicFile>> &files);
+
+        /**
+         * @brief Hand an encoded block to the shuffle, or write it to the
+         *      map.part file of its partition
+         *
+         * @param part the reduce partition
+         * @param block the encoded records
+        */
+        void writeBlock(int part, string &&block);
+
+        /**
+         * @brief Encode a partition in the intermediate format of the job
+         *
+         * @param part the reduce partition
+         * @return string the encoded partition
+        */
+        string encodeBlock(int part);
+
+        /**
+         * @brief Encode a partition as key,value text lines
+         *
+         * @param part the reduce partition
+         * @return string the encoded partition
+        */
+        string encodeText(int part);
+
+        /**
+         * @brief Sort the records of a partition and encode them as a run
+         *
+         * @param part the reduce partition
+         * @return string the encoded run
+        */
+        string encodeRun(int part);
+
+        /**
+         * @brief Encode a partition as a dictionary run, its keys once in
+         *      the dictionary and its records as key ids and values, or
+         *      as a plain run when combining
+         *
+         * @param part the reduce partition
+         * @return string the encoded run
+        */
+        string encodeDictionary(int part);
+
+        /**
+         * @brief Serialize the sketch of a partition and reset it
+         *
+         * @param part the reduce partition
+         * @return string the serialized sketch
+        */
+        string encodeSketch(int part);
+
+        /**
+         * @brief Append a key-value pair to its partition, or fold it
+         *      into the partition's combiner
+         *
+         * @param key the key emitted by the map functor
+         * @param value the value emitted by the map functor
+        */
+        void emit(string_view key, typename Job::Value value);
+
+        /**
+         * @brief Sort every partition and append it as a run to its
+         *      map.part file, once the buffered records exceed the
+         *      memory budget
         */
-        int partition(string key);
+        void spill();
 
         /**
-         * @brief Check if a word is latin and convert it to lowercase
+         * @brief Hand a partition to its reducer once it holds a full chunk,
+         *      used when the map and reduce phases are pipelined
          *
-         * @param w the word to check
-         * @return true if the word is latin
-         * @return false if the word is not latin
+         * @param part the reduce partition
         */
-        bool isLatin(string &word);
+        void flushIfFull(int part);
 
         /**
-         * @brief In-place word stripping around apostrophes and commas
+         * @brief Write each combined key of a partition once as key,value
          *
-         * @param words the words to strip
+         * @param part the reduce partition
         */
-        void symbolStrip(vector<string> &words);
+        void flushCombiner(int part);
 };
 
 #endif // MAPPER_HPP
\ No newline at end of file
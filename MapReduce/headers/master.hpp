@@ -2,74 +2,224 @@
 #define MASTER_HPP
 
 #include "libraries.hpp"
+#include "options.hpp"
 #include "mapper.hpp"
+#include "reducer.hpp"
+#include "pool.hpp"
+#include "stats.hpp"
+#include "coordinator.hpp"
+#include "cache.hpp"
+#include "watch.hpp"
 
 class Master {
     public:
         /**
          * @brief Construct a new Master object
-         *      Begin the map reduce process
+         *      The Master owns a worker pool that every phase of every
+         *      job it runs reuses
          *
-         * @param input_dir the input directory
-         * @param output_dir the output directory
-         * @param nworkers the number of worker threads
-         * @param nreduce the number of reduce threads
+         * @param nthreads the pool threads to start right away
          */
-        Master(string input_dir,
-                string output_dir,
-                int nworkers,
-                int nreduce
-        );
+        Master(int nthreads = 0);
+
+        /**
+         * @brief Run a map reduce job
+         *      Can be called again for more jobs on the same threads
+         *
+         * @param options the job options
+         * @return true if the job completed
+         */
+        bool run(const Options &options);
 
     private:
-        string input_dir;       /**< the input directory */
-        string output_dir;      /**< the output directory */
-        int nworkers;           /**< the number of worker threads */
-        int nreduce;            /**< the number of reduce threads */
-        std::thread *workers;   /**< the worker threads */
+        WorkerPool pool;        /**< the threads running mappers and reducers */
+        Options options;        /**< the job options */
         vector<string> files;   /**< the files in the input directory */
+        vector<MapTask> tasks;  /**< the map tasks, largest first */
+        unique_ptr<Shuffle> shuffle;    /**< the in-memory shuffle, if enabled */
+        JobStats stats;                 /**< measurements for the job report */
+        Partitioner partitioner;        /**< assigns keys to reduce partitions */
+        unique_ptr<MapCache> cache;     /**< the map cache, with --incremental */
+        unordered_map<string, int> watched; /**< index of each watched file in files */
+        vector<uint64_t> mapped;        /**< bytes of each watched file mapped so far */
+        vector<uint64_t> inodes;        /**< inode of each watched file when it was last mapped */
 
         /**
          * @brief Start the map phase
          *      1) Count the number of files in the input directory
-         *      2) Create a mapper for each thread
-         *      3) Allocate an equal number of files to each mapper
-         *      4) Start a new thread for each mapper
+         *      2) Cut the files into splits and queue them, largest first,
+         *         in a work-stealing scheduler
+         *      3) Create a mapper for each worker
+         *      4) Run every mapper on a pool thread, pulling files from
+         *         the scheduler until none are left
          *      5) Wait for all workers to finish
          */
         void mapPhase();
 
+        /**
+         * @brief Run a mapper for every worker on the pool and wait for them
+         *
+         * @tparam Job the job to map
+         * @param scheduler the scheduler handing out map tasks
+         */
+        template <typename Job>
+        void runMappers(TaskScheduler &scheduler);
+
         /**
          * @brief Start the reduce phase
-         *      1) Create a reducer for each thread
-         *      2) Start a new thread for each reducer
+         *      1) Create a reducer for each partition
+         *      2) Run every reducer on a pool thread
          *      3) Wait for all workers to finish
          */
         void reducePhase();
 
+        /**
+         * @brief Run a reducer for every partition on the pool and wait for them
+         *
+         * @tparam Job the job to reduce
+         */
+        template <typename Job>
+        void runReducers();
+
+        /**
+         * @brief Run the map and reduce phases concurrently
+         *      1) Create bounded in-memory shuffle channels
+         *      2) Run the reduce phase on the pool, whose reducers
+         *         aggregate chunks as they arrive
+         *      3) Run the map phase alongside, whose mappers flush full chunks
+         *      4) Wait for the reducers to drain the channels
+         */
+        void pipelinePhase();
+
+        /**
+         * @brief Run the map and reduce tasks on worker processes
+         *      1) Cut the input into map tasks and create the partitioner
+         *      2) Let a Coordinator spawn the workers and hand out the
+         *         tasks, re-executing the tasks of failed workers
+         *
+         * @return true if every task completed
+         */
+        bool processPhase();
+
+        /**
+         * @brief Keep mapping the input directory until SIGINT or SIGTERM
+         *      1) Watch the directory with inotify and queue the files
+         *         already in it
+         *      2) Every watch_interval milliseconds, map the bytes the
+         *         changed files gained into an in-memory shuffle
+         *      3) Fold them into reducers that stay resident for the
+         *         whole watch, and publish a new output.txt
+         *
+         * @return true if the directory could be watched
+         */
+        bool watchPhase();
+
+        /**
+         * @brief Run the rounds of a watch, see watchPhase
+         *
+         * @tparam Job the job to run
+         * @param watch the watched input directory
+         */
+        template <typename Job>
+        void watchInput(DirectoryWatch &watch);
+
+        /**
+         * @brief Queue map tasks for the bytes of changed files that were
+         *      not mapped yet
+         *      Files are only mapped up to their last whole record, since
+         *      a writer may still append to it, until the final round maps
+         *      what is left. A file that was replaced by another one is
+         *      mapped from its start
+         *
+         * @tparam Job the job whose records are mapped
+         * @param changed the paths of the changed files
+         * @param final map the files to their end
+         */
+        template <typename Job>
+        void createDeltaTasks(const unordered_set<string> &changed, bool final);
+
         /**
          * @brief Start the merge phase
-         *      1) Read the output of the reduce phase
-         *      2) Sort the output by value and then key
-         *      3) Write the output to a file
+         *      1) Open the sorted output of every reducer
+         *      2) Merge them with a heap ordered by value and then key
+         *      3) Stream the merged records to the output file, stopping
+         *         after top_k records for a top-k query
+         *      With range partitions the outputs are ordered by key and
+         *      are concatenated instead
+         *      output.txt is replaced atomically, so it can be read while
+         *      a watch publishes a new one
          */
         void mergePhase();
 
+        /**
+         * @brief Start the merge phase of an approx job
+         *      1) Read the sketch of every reducer
+         *      2) Merge their HyperLogLogs into the distinct key estimate
+         *      3) Write the top_k heavy hitters of all partitions, each
+         *         with the error bound of its partition's Count-Min sketch
+         */
+        void mergeSketches();
+
+        /**
+         * @brief Record the merger's stats and end the merge phase
+         *
+         * @param merger the merger's counters
+         * @param watch started with the merge phase
+         */
+        void finishMerge(WorkerStats &merger, const Stopwatch &watch);
+
         /**
          * @brief Run the map reduce process
          *     1) map
-         *     2) reduce
+         *     2) reduce (or map and reduce pipelined, or both on
+         *        worker processes)
          *     3) merge
+         *     With a watch, the rounds of watchPhase instead
+         *
+         * @return true if the job completed
          */
-        void beginMapReduce();
+        bool beginMapReduce();
 
         /**
          * @brief Count the number of files in the input directory
-         *      Store the files in a vector
+         *      Store the files in a vector, sorted by descending size
          *
          * @return int the number of files
          */
         int countAndStoreFiles();
+
+        /**
+         * @brief Cut every file into map tasks of at most split_size bytes
+         *      Store the tasks in a vector, sorted by descending size
+         */
+        void createTasks();
+
+        /**
+         * @brief Open the map cache and mark the tasks of unchanged files
+         *      as cached, with --incremental
+         */
+        void openCache();
+
+        /**
+         * @brief Record the files of a completed job in the map cache
+         */
+        void commitCache();
+
+        /**
+         * @brief Create the partitioner of the job
+         *      For range partitioning, sample keys from the input and
+         *      split them into nreduce ranges of equal load
+         */
+        void createPartitioner();
+
+        /**
+         * @brief Map windows spread over the input files to sample keys
+         *
+         * @tparam Job the job whose keys are sampled
+         * @return vector<string> one key per sampled record
+         */
+        template <typename Job>
+        vector<string> sampleKeys();
 };
 
 /**
@@ -81,7 +231,7 @@ class Master {
  * @param b the second pair
  * @return true if a.value > b.value
  */
-bool sortByValue(const pair<string, int> &a,
-                const pair<string, int> &b);
+bool sortByValue(const pair<string_view, uint64_t> &a,
+                const pair<string_view, uint64_t> &b);
 
 #endif // MASTER_HPP
\ No newline at end of file
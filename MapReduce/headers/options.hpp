@@ -0,0 +1,118 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include "libraries.hpp"
+
+typedef enum {
+    SHUFFLE_FILE,       /**< mappers write map.part files */
+    SHUFFLE_MEMORY      /**< mappers hand blocks to reducers in memory */
+} ShuffleMode;
+
+typedef enum {
+    IO_MMAP,            /**< map the input files, write with pwrite */
+    IO_URING,           /**< stream reads and queue writes on an io_uring */
+    IO_PREAD            /**< stream reads with pread and readahead hints */
+} IoMode;
+
+typedef enum {
+    JOB_WORDCOUNT,      /**< count words */
+    JOB_BIGRAMS         /**< count pairs of consecutive words in a line */
+} JobKind;
+
+typedef enum {
+    PARTITION_POLY,     /**< polynomial rolling hash of the key */
+    PARTITION_WYHASH,   /**< 64-bit multiply-mix hash of the key */
+    PARTITION_RANGE     /**< sampled key ranges, ordered by key */
+} PartitionMode;
+
+/**
+ * @brief Options struct
+ * The command line options of a map reduce job, shared by the
+ * Master and all of its Mappers and Reducers.
+*/
+typedef struct Options {
+    string input_dir;               /**< the input directory */
+    string output_dir;              /**< the output directory */
+    int nworkers = 1;               /**< the number of map worker threads */
+    int nreduce = 1;                /**< the number of reduce threads */
+    JobKind job = JOB_WORDCOUNT;    /**< the job to run */
+    PartitionMode partition = PARTITION_POLY;   /**< how keys are assigned to reducers */
+    bool combine = false;           /**< aggregate counts inside each mapper */
+    bool text_intermediate = false; /**< write key,value text instead of run files */
+    bool dictionary = false;        /**< encode intermediate keys as per-partition dictionary ids */
+    int compress = 0;               /**< compression level of the intermediate and
+                                         reduce.part files, 0 to write them raw */
+    uint64_t split_size = 0;        /**< bytes per map task, 0 maps whole files */
+    ShuffleMode shuffle = SHUFFLE_FILE; /**< how map output reaches the reducers */
+    IoMode io = IO_MMAP;            /**< how mappers read their input and write their partitions */
+    bool pipeline = false;          /**< overlap the map and reduce phases */
+    uint64_t top_k = 0;             /**< only output the top_k words, 0 for all */
+    bool processes = false;         /**< run the tasks on worker processes */
+    uint64_t worker_timeout = 2000; /**< milliseconds without a heartbeat before a
+                                         worker process is declared failed */
+    bool backup_tasks = true;       /**< back up straggling tasks of worker processes */
+    bool incremental = false;       /**< reuse the map cache of unchanged input files */
+    bool rebuild = false;           /**< ignore the map cache and write it again */
+    uint64_t memory_budget = 0;     /**< bytes each mapper and reducer may buffer
+                                         before spilling runs, 0 for no limit */
+    bool approx = false;            /**< estimate counts with fixed-size sketches */
+    bool watch = false;             /**< keep mapping new input until interrupted */
+    uint64_t watch_interval = 1000; /**< milliseconds between output snapshots of a watch */
+} Options;
+
+/**
+ * @brief Check if a job writes its output ordered by key
+ *      Range partitions are ordered by key, so the output is too unless
+ *      a top-k query orders it by count
+ *
+ * @param options the job options
+ * @return true if the output is ordered by key
+*/
+inline bool keyOrdered(const Options &options) {
+    return options.partition == PARTITION_RANGE && !options.top_k;
+}
+
+/**
+ * @brief Name of the intermediate file a mapper writes for a reducer
+ *
+ * @param options the job options
+ * @param mapper the map worker id
+ * @param reducer the reduce partition
+ * @return string the path of the map.part file
+*/
+inline string mapPartFile(const Options &options, int mapper, int reducer) {
+    return options.output_dir + "/map.part-" + to_string(mapper) + "-" + to_string(reducer) +
+        (options.text_intermediate ? ".txt" : ".bin");
+}
+
+/**
+ * @brief Name of the sorted output file of a reducer
+ *
+ * @param options the job options
+ * @param reducer the reduce partition
+ * @return string the path of the reduce.part file, of compressed blocks with
+ *      compress or a sketch with approx
+*/
+inline string reducePartFile(const Options &options, int reducer) {
+    if (options.approx) return options.output_dir + "/reduce.part-" + to_string(reducer) + ".bin";
+    return options.output_dir + "/reduce.part-" + to_string(reducer) + (options.compress ? ".txt.lz" : ".txt");
+}
+
+/**
+ * @brief Parse a byte count with an optional K, M or G suffix
+ *
+ * @param value the size, for example 64M
+ * @return uint64_t the size in bytes
+*/
+inline uint64_t parseSize(const string &value) {
+    size_t end;
+    uint64_t size = stoull(value, &end);
+    string suffix = value.substr(end);
+    if (suffix == "K" || suffix == "k") size <<= 10;
+    else if (suffix == "M" || suffix == "m") size <<= 20;
+    else if (suffix == "G" || suffix == "g") size <<= 30;
+    else if (!suffix.empty()) throw invalid_argument("invalid size: " + value);
+    return size;
+}
+
+#endif // OPTIONS_HPP
@@ -0,0 +1,74 @@
+#ifndef PARTITIONER_HPP
+#define PARTITIONER_HPP
+
+#include "libraries.hpp"
+#include "hashtable.hpp"
+#include "options.hpp"
+
+/**
+ * @brief Partitioner class
+ * Maps a key to the reduce partition that owns it.
+ *
+ *      poly        the original polynomial rolling hash (* 31) modulo
+ *                  nreduce
+ *      wyhash      the 64-bit multiply-mix hashKey of the CountTable,
+ *                  reduced to [0, nreduce) with a multiply-shift
+ *      range       partition r owns the keys in [splits[r - 1], splits[r]),
+ *                  so the partitions are ordered by key
+*/
+class Partitioner {
+    public:
+        /**
+         * @brief Construct a new Partitioner object
+         *
+         * @param mode how keys are partitioned
+         * @param nreduce the number of reduce partitions
+         * @param splits the nreduce - 1 sorted split points of the range mode
+         * @return Partitioner the new Partitioner object
+        */
+        Partitioner(PartitionMode mode = PARTITION_POLY, int nreduce = 1, vector<string> splits = {});
+
+        /**
+         * @brief Pick split points that give every partition the same share
+         *      of a sample of keys
+         *
+         * @param samples the sampled keys, one entry per record, sorted in place
+         * @param nreduce the number of reduce partitions
+         * @return vector<string> the nreduce - 1 sorted split points
+        */
+        static vector<string> chooseSplits(vector<string> &samples, int nreduce);
+
+        /**
+         * @brief The split points of the range mode, empty otherwise
+        */
+        const vector<string> &getSplits() const;
+
+        /**
+         * @brief The reduce partition of a key
+         *
+         * @param key the key to partition
+         * @return int the reduce partition number
+        */
+        int partition(string_view key) const {
+            switch (this->mode) {
+                case PARTITION_WYHASH:
+                    return int(((__uint128_t) hashKey(key) * this->nreduce) >> 64);
+                case PARTITION_RANGE:
+                    return int(upper_bound(this->splits.begin(), this->splits.end(), key) - this->splits.begin());
+                default: {
+                    size_t hash = 0;
+                    for (char c : key) {
+                        hash = (hash * 31) + c;
+                    }
+                    return int(hash % this->nreduce);
+                }
+            }
+        }
+
+    private:
+        PartitionMode mode;     /**< how keys are partitioned */
+        uint64_t nreduce;       /**< the number of reduce partitions */
+        vector<string> splits;  /**< split points of the range mode */
+};
+
+#endif // PARTITIONER_HPP
@@ -0,0 +1,67 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include "libraries.hpp"
+
+/**
+ * @brief WorkerPool class
+ * A set of persistent threads that run batches of tasks, so phases and
+ * jobs reuse the same threads instead of starting new ones. Every task
+ * of a batch is guaranteed its own thread, because mappers and reducers
+ * may wait on each other through the shuffle; the pool starts more
+ * threads only when all of its threads are busy. Batches may be run
+ * from inside a task of another batch.
+*/
+class WorkerPool {
+    public:
+        /**
+         * @brief Construct a new WorkerPool object
+         *
+         * @param nthreads the threads to start right away
+         * @return WorkerPool the new WorkerPool object
+        */
+        WorkerPool(int nthreads = 0);
+
+        /**
+         * @brief Stop and join every thread
+        */
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        /**
+         * @brief Run task(0) to task(ntasks - 1) concurrently, each on
+         *      its own pool thread, and wait for all of them
+         *
+         * @param ntasks the number of tasks
+         * @param task called with the index of each task
+        */
+        void run(int ntasks, const function<void(int)> &task);
+
+        /**
+         * @brief The number of threads the pool has started
+        */
+        size_t size();
+
+    private:
+        typedef struct Batch {
+            const function<void(int)> *task;    /**< the function to run */
+            int pending;                        /**< tasks not finished yet */
+        } Batch;
+
+        mutex lock;                     /**< guards every member below */
+        condition_variable wake;        /**< signalled when tasks are queued */
+        condition_variable done;        /**< signalled when a batch finishes */
+        vector<std::thread> threads;    /**< the pool threads */
+        deque<pair<Batch*, int>> queue; /**< tasks not started yet */
+        size_t idle = 0;                /**< threads not running a task */
+        bool stopping = false;          /**< set by the destructor */
+
+        /**
+         * @brief Main loop of a pool thread
+        */
+        void work();
+};
+
+#endif // POOL_HPP
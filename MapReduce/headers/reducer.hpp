@@ -2,42 +2,204 @@
 #define REDUCER_HPP
 
 #include "libraries.hpp"
+#include "hashtable.hpp"
+#include "job.hpp"
+#include "options.hpp"
+#include "runfile.hpp"
+#include "shuffle.hpp"
+#include "sketch.hpp"
+#include "stats.hpp"
+
+/**
+ * @brief RunSource struct
+ * A run of a file to stream, see RunStream.
+*/
+typedef struct RunSource {
+    string file;        /**< the file holding the run */
+    uint64_t offset;    /**< where the run's header starts */
+} RunSource;
 
 /**
  * @brief Reducer class
  * The Reducer class is responsible for reducing the output
- * of the mappers and writing the unsorted output to a file.
+ * of the mappers and writing its share of the final output,
+ * sorted by value and then key, to a file. Values of equal keys
+ * are folded with the reduce functor of a Job.
+ *
+ * With dictionary runs, the Reducer aggregates the values of each
+ * key id in an array and only resolves the ids to keys for the output.
+ *
+ * With approx, the Reducer merges the sketches the mappers wrote for
+ * its partition and writes the merged sketch instead of records.
+ *
+ * With a memory budget, the Reducer streams the runs of the map.part
+ * files through bounded buffers in an external multi-way merge, with
+ * more than one pass when there are too many runs to merge at once,
+ * and spills its sorted output in runs that are merged again at the end.
+ *
+ * @tparam Job the job to run, see job.hpp
 */
+template <typename Job>
 class Reducer {
     public:
         /**
          * @brief Construct a new Reducer object
          *
          * @param id the worker id
-         * @param input_dir the input directory
-         * @param output_dir the output directory
-         * @param nworkers the number of worker threads
+         * @param options the job options
+         * @param nmaps the number of map.part files per partition
+         * @param shuffle the in-memory shuffle, or nullptr to read files
          * @return Reducer the new Reducer object
         */
         Reducer(int id,
-                string input,
-                string output,
-                int nworkers
+                const Options *options,
+                int nmaps,
+                Shuffle *shuffle
         );
 
         /**
          * @brief Reduce the output of the mappers
-         *     1) Read the output of each mapper for this reducer
-         *     2) Count the number of occurrences of each key
-         *     3) Write the output to a file
+         *     1) Read the output of each mapper for this reducer,
+         *        from its map.part file or from the shuffle
+         *     2) Reduce the values of each key
+         *     3) Sort the keys by value and then key
+         *     4) Write the output to a file
         */
         void reduce();
 
+        /**
+         * @brief Fold the blocks of one round of a watched input into the
+         *      reducer's counts, which stay resident between rounds
+         *
+         * @param shuffle the shuffle the round's mappers filled and closed
+        */
+        void absorb(Shuffle *shuffle);
+
+        /**
+         * @brief Write the counts absorbed so far to the reduce.part file
+        */
+        void publish();
+
+        /**
+         * @brief What the reducer did, once reduce returned
+        */
+        const WorkerStats &getStats() const;
+
     private:
-        int worker_id;      /**< the worker id */
-        string input_dir;   /**< the input directory */
-        string output_dir;  /**< the output directory */
-        int nworkers;       /**< the number of worker threads */
+        int worker_id;              /**< the worker id */
+        const Options *options;     /**< the job options */
+        int nmaps;                  /**< the number of map.part files per partition */
+        Shuffle *shuffle;           /**< in-memory shuffle, nullptr for files */
+        CountTable counts;          /**< aggregated counts of the text and chunk paths */
+        KeyDictionary dictionary;   /**< global ids of the keys of dictionary runs */
+        vector<RunReader> runs;     /**< loaded runs of the run path */
+        vector<pair<string_view, uint64_t>> records;    /**< reduced records, keys
+                                                             point into counts or runs */
+        typename Job::Reduce reduce_fn;     /**< the job's reduce functor */
+        WorkerStats stats;                  /**< counters for the job report */
+        Arena arena;                        /**< keys of the records held under a memory budget */
+        uint64_t buffered = 0;              /**< bytes of the records held under a memory budget */
+        vector<unique_ptr<AtomicFile>> scratch; /**< spilled and partially merged runs */
+        vector<RunSource> sorted;           /**< spilled runs of output records */
+        unique_ptr<AtomicFile> output;      /**< reduce.part file being written */
+        string text;                        /**< output lines not written yet */
+
+        /**
+         * @brief Reduce the key,value lines of the text map.part files or blocks
+        */
+        void reduceText();
+
+        /**
+         * @brief Merge the key-sorted runs of all mappers and reduce
+         *      the values of equal keys
+        */
+        void reduceRuns();
+
+        /**
+         * @brief Merge the dictionary runs of all mappers on key ids, the
+         *      keys of each run are looked up once to map its ids to the
+         *      reducer's ids and are only resolved again for the output
+        */
+        void reduceDictionary();
+
+        /**
+         * @brief Merge the sketches of all mappers into one and write it
+         *      to the reduce.part file
+        */
+        void reduceSketches();
+
+        /**
+         * @brief Aggregate pipelined run chunks into a table as they arrive,
+         *      while the mappers are still running
+        */
+        void reduceChunks();
+
+        /**
+         * @brief Merge the runs of the map.part files and write the output
+         *      without holding more than the memory budget
+        */
+        void reduceBounded();
+
+        /**
+         * @brief Merge runs through bounded buffers, first merging groups
+         *      of them into scratch runs while there are too many to merge
+         *      in one pass
+         *
+         * @param sources the runs to merge
+         * @param less the order of the records in the runs
+         * @param combine whether to fold the values of equal keys, for
+         *      runs ordered by key
+         * @param emit called as emit(string_view key, uint64_t count) for
+         *      every merged record, the key is only valid during the call
+        */
+        template <typename Less, typename Emit>
+        void mergeRuns(vector<RunSource> sources, Less less, bool combine, Emit &&emit);
+
+        /**
+         * @brief Merge runs in a single pass, see mergeRuns
+        */
+        template <typename Less, typename Emit>
+        void mergePass(const vector<RunSource> &sources, Less less, bool combine, Emit &&emit);
+
+        /**
+         * @brief Keep a merged record under the memory budget: write it
+         *      out when the output is ordered by key, keep it in the top-k
+         *      heap, or buffer it and spill the buffer as a sorted run
+         *
+         * @param key the key, copied if it is kept
+         * @param count the reduced value
+        */
+        void keep(string_view key, uint64_t count);
+
+        /**
+         * @brief Sort the buffered records and write them as a scratch run
+        */
+        void spillRecords();
+
+        /**
+         * @brief Append an output line, writing the lines out in chunks
+        */
+        void writeLine(string_view key, uint64_t count);
+
+        /**
+         * @brief Write the buffered output lines, as one compressed block
+         *      with compress
+        */
+        void flushText();
+
+        /**
+         * @brief Add a reduced record, keeping only the best top_k records
+         *      in a bounded heap when a top-k query is running
+         *
+         * @param key the key
+         * @param count the summed value
+        */
+        void collect(string_view key, uint64_t count);
+
+        /**
+         * @brief Sort the records and write them to the reduce.part file
+        */
+        void writeOutput();
 };
 
 #endif // REDUCER_HPP
\ No newline at end of file
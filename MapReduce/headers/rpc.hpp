@@ -0,0 +1,186 @@
+#ifndef RPC_HPP
+#define RPC_HPP
+
+#include "libraries.hpp"
+#include "stats.hpp"
+
+typedef enum {
+    MSG_HELLO,      /**< worker to master: the worker's pid */
+    MSG_JOB,        /**< master to worker: options, files, tasks and splits */
+    MSG_REQUEST,    /**< worker to master: ready for a task */
+    MSG_MAP,        /**< master to worker: map the task with this index */
+    MSG_REDUCE,     /**< master to worker: reduce the partition with this index */
+    MSG_DONE,       /**< worker to master: task index and the worker's stats */
+    MSG_HEARTBEAT,  /**< worker to master: still alive */
+    MSG_EXIT        /**< master to worker: no tasks are left */
+} MessageType;
+
+/**
+ * @brief Message class
+ * A message between the master and a worker process: a type byte
+ * followed by fields, each a varint or a varint-length byte string.
+ * Fields are read back in the order they were put.
+*/
+class Message {
+    public:
+        /**
+         * @brief Construct a new Message object to put fields into
+         *
+         * @param type the message type
+         * @return Message the new Message object
+        */
+        Message(MessageType type = MSG_HEARTBEAT);
+
+        /**
+         * @brief Construct a new Message object to get fields from
+         *
+         * @param bytes the received message
+         * @return Message the new Message object
+        */
+        Message(string &&bytes);
+
+        /**
+         * @brief The message type
+        */
+        MessageType type() const;
+
+        /**
+         * @brief The encoded message
+        */
+        const string &bytes() const;
+
+        /**
+         * @brief Append a number
+        */
+        Message &put(uint64_t value);
+
+        /**
+         * @brief Append a byte string
+        */
+        Message &put(string_view value);
+
+        /**
+         * @brief Read the next number
+         *
+         * @return true if a number was read
+        */
+        bool get(uint64_t &value);
+
+        /**
+         * @brief Read the next byte string
+         *
+         * @return true if a string was read
+        */
+        bool get(string &value);
+
+    private:
+        string buffer;      /**< type byte and fields */
+        size_t pos = 1;     /**< offset of the next field to read */
+};
+
+/**
+ * @brief Connection class
+ * A Unix-domain stream socket carrying length-prefixed messages. The
+ * master reads whatever a poll reported with fill and takes complete
+ * messages with pop, the workers block in receive.
+*/
+class Connection {
+    public:
+        /**
+         * @brief Construct a new Connection object
+         *
+         * @param fd a connected socket, owned and closed by the Connection
+         * @return Connection the new Connection object
+        */
+        Connection(int fd = -1);
+
+        /**
+         * @brief Close the socket
+        */
+        ~Connection();
+
+        Connection(const Connection &) = delete;
+        Connection &operator=(const Connection &) = delete;
+
+        /**
+         * @brief Connect to a listening socket
+         *
+         * @param path the socket path
+         * @return true if connected
+        */
+        bool connectTo(const string &path);
+
+        /**
+         * @brief The socket, -1 if closed
+        */
+        int fd() const;
+
+        /**
+         * @brief Close the socket
+        */
+        void close();
+
+        /**
+         * @brief Send a message, waiting until it is fully written
+         *
+         * @param message the message
+         * @return true if the message was sent
+        */
+        bool send(const Message &message);
+
+        /**
+         * @brief Read the bytes available on the socket, waiting if
+         *      there are none
+         *
+         * @return ssize_t the bytes read, 0 once the peer closed, -1 on error
+        */
+        ssize_t fill();
+
+        /**
+         * @brief Take the next complete message out of the read buffer
+         *
+         * @param message the message
+         * @return true if a complete message was buffered
+        */
+        bool pop(Message &message);
+
+        /**
+         * @brief Wait for the next message
+         *
+         * @param message the message
+         * @return true if a message was received
+        */
+        bool receive(Message &message);
+
+    private:
+        int socket;         /**< the socket, -1 if closed */
+        string pending;     /**< bytes read but not popped yet */
+};
+
+/**
+ * @brief Append the stats of a task to a message
+ *
+ * @param message the message
+ * @param stats the stats, times are sent in microseconds
+*/
+void putStats(Message &message, const WorkerStats &stats);
+
+/**
+ * @brief Read the stats of a task from a message
+ *
+ * @param message the message
+ * @param stats the stats
+ * @return true if the stats were read
+*/
+bool getStats(Message &message, WorkerStats &stats);
+
+/**
+ * @brief Create a Unix-domain socket listening at a path
+ *      An existing file at the path is replaced
+ *
+ * @param path the socket path
+ * @return int the listening socket, -1 on error
+*/
+int listenUnix(const string &path);
+
+#endif // RPC_HPP
@@ -0,0 +1,520 @@
+#ifndef RUNFILE_HPP
+#define RUNFILE_HPP
+
+#include "libraries.hpp"
+#include "codec.hpp"
+#include "io.hpp"
+
+/**
+ * Binary intermediate (run) file layout, in native byte order:
+ *
+ *      RunHeader
+ *      records:  varint key length, key bytes, varint count
+ *
+ * Records are sorted by key. The checksum covers the record bytes.
+ * A map.part file written under a memory budget holds one run per
+ * spill of its mapper, back to back, the last one written at the end.
+ *
+ * With the RUN_DICTIONARY flag, the records are not sorted and their
+ * keys are ids into a dictionary that starts the payload:
+ *
+ *      varint number of keys, each key as varint length and bytes
+ *      records:  varint key id, varint count
+ *
+ * With the RUN_COMPRESSED flag, the payload is stored as framed blocks
+ * (see codec.hpp) that decode to the payload above, and the payload
+ * size and the checksum are those of the stored blocks.
+*/
+const char RUN_MAGIC[4] = {'M', 'R', 'R', 'N'};
+const uint16_t RUN_VERSION = 1;
+
+/* RunHeader flag of a dictionary-encoded run */
+const uint16_t RUN_DICTIONARY = 1;
+
+/* RunHeader flag of a run whose payload is stored as compressed blocks */
+const uint16_t RUN_COMPRESSED = 2;
+
+/* FNV-1a offset basis, the checksum of no bytes */
+const uint64_t RUN_CHECKSUM_SEED = 14695981039346656037ULL;
+
+typedef struct RunHeader {
+    char magic[4];          /**< RUN_MAGIC */
+    uint16_t version;       /**< RUN_VERSION */
+    uint16_t flags;         /**< RUN_DICTIONARY and RUN_COMPRESSED bits */
+    uint64_t records;       /**< number of records */
+    uint64_t payload;       /**< number of record bytes after the header */
+    uint64_t checksum;      /**< FNV-1a hash of the record bytes */
+} RunHeader;
+
+/**
+ * @brief Append a LEB128 varint
+ *
+ * @param out the buffer to append to
+ * @param v the value to encode
+*/
+inline void putVarint(string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+/**
+ * @brief Decode a LEB128 varint
+ *
+ * @param in the encoded bytes
+ * @param pos the offset to decode at, advanced past the varint
+ * @param v the decoded value
+ * @return true if a complete varint was decoded
+*/
+inline bool getVarint(string_view in, size_t &pos, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        unsigned char byte = in[pos++];
+        v |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief FNV-1a checksum of a byte range
+ *
+ * @param bytes the bytes to hash
+ * @param hash the checksum of the bytes before them, to hash a run in pieces
+ * @return uint64_t the checksum
+*/
+uint64_t runChecksum(string_view bytes, uint64_t hash = RUN_CHECKSUM_SEED);
+
+/**
+ * @brief Encode a dictionary-encoded run
+ *
+ * @param keys the dictionary, the id of a key is its index
+ * @param records the encoded id and count records
+ * @param nrecords the number of records
+ * @param level the compression level of the payload, 0 to store it raw
+ * @return string the bytes of the run
+*/
+string encodeDictionaryRun(const vector<string_view> &keys, string_view records, uint64_t nrecords, int level = 0);
+
+/**
+ * @brief AtomicFile class
+ * A file that is written under a temporary name unique to this process
+ * and only appears under its own name once committed with a rename.
+ * A reader sees either a complete file or none, so two executions of
+ * the same task can commit the same file in any order. The temporary
+ * file is removed if the AtomicFile is destroyed without a commit,
+ * which also makes it a self-cleaning scratch file.
+*/
+class AtomicFile {
+    public:
+        /**
+         * @brief Create the temporary file
+         *
+         * @param filename the name the file gets once committed
+         * @return AtomicFile the new AtomicFile object
+        */
+        AtomicFile(const string &filename);
+
+        /**
+         * @brief Close the file and remove it unless it was committed
+        */
+        ~AtomicFile();
+
+        AtomicFile(const AtomicFile &) = delete;
+        AtomicFile &operator=(const AtomicFile &) = delete;
+
+        /**
+         * @brief Append bytes to the end of the file
+         *
+         * @param bytes the bytes to write
+         * @return true if every write so far succeeded
+        */
+        bool append(string_view bytes);
+
+        /**
+         * @brief Queue bytes to append on an I/O engine, which must be
+         *      drained before the file is committed or destroyed
+         *
+         * @param bytes the bytes to write, copied by the engine
+         * @param engine the engine that writes them
+         * @return true if every write so far succeeded
+        */
+        bool append(string_view bytes, IoEngine *engine);
+
+        /**
+         * @brief Overwrite bytes that were already appended
+         *
+         * @param offset where to write
+         * @param bytes the bytes to write
+         * @return true if every write so far succeeded
+        */
+        bool writeAt(uint64_t offset, string_view bytes);
+
+        /**
+         * @brief Close the file and rename it to its name
+         *
+         * @return true if every write and the rename succeeded
+        */
+        bool commit();
+
+        /**
+         * @brief The bytes appended so far
+        */
+        uint64_t size() const;
+
+        /**
+         * @brief Where the bytes are, the temporary name until committed
+        */
+        const string &path() const;
+
+    private:
+        string filename;        /**< the name of the committed file */
+        string temporary;       /**< the name while it is written */
+        int fd = -1;            /**< the open temporary file */
+        bool ok = false;        /**< every write succeeded */
+        bool committed = false; /**< renamed to filename */
+        uint64_t written = 0;   /**< bytes appended */
+};
+
+/**
+ * @brief Write a whole intermediate or output file atomically
+ *      through an AtomicFile
+ *
+ * @param filename the file to write
+ * @param bytes the contents of the file
+ * @return true if the file was written and renamed
+*/
+bool commitFile(const string &filename, string_view bytes);
+
+/**
+ * @brief TextReader class
+ * Iterates over the key,value lines of a text map.part or reduce.part
+ * file in place. Keys point into the parsed text.
+*/
+class TextReader {
+    public:
+        /**
+         * @brief Construct a new TextReader object
+         *
+         * @param text the bytes to parse
+         * @return TextReader the new TextReader object
+        */
+        TextReader(string_view text) : text(text) {}
+
+        /**
+         * @brief Advance to the next key,value line
+         *
+         * @return true if a record was read
+         * @return false at the end of the text
+        */
+        bool next() {
+            while (this->pos < this->text.size()) {
+                size_t end = this->text.find('\n', this->pos);
+                if (end == string_view::npos) end = this->text.size();
+                string_view line = this->text.substr(this->pos, end - this->pos);
+                this->pos = end + 1;
+
+                size_t comma = line.rfind(',');
+                if (comma == string_view::npos) continue;
+                this->current_key = line.substr(0, comma);
+                this->current_count = 0;
+                from_chars(line.data() + comma + 1, line.data() + line.size(), this->current_count);
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief The key of the current record
+        */
+        string_view key() const { return this->current_key; }
+
+        /**
+         * @brief The value of the current record
+        */
+        uint64_t count() const { return this->current_count; }
+
+    private:
+        string_view text;           /**< the text being parsed */
+        size_t pos = 0;             /**< offset of the next line */
+        string_view current_key;    /**< key of the current record */
+        uint64_t current_count = 0; /**< value of the current record */
+};
+
+/**
+ * @brief Parse text key,value lines
+ *
+ * @param text the bytes of a text map.part or reduce.part file
+ * @param f called as f(string_view key, uint64_t value) for each line
+*/
+template <typename F>
+void forEachTextRecord(string_view text, F &&f) {
+    TextReader reader(text);
+    while (reader.next()) {
+        f(reader.key(), reader.count());
+    }
+}
+
+/**
+ * @brief RunWriter class
+ * The RunWriter encodes key-sorted records into a run file.
+*/
+class RunWriter {
+    public:
+        /**
+         * @brief Construct a new RunWriter object
+         *
+         * @param level the compression level of the payload, 0 to store it raw
+         * @return RunWriter the new RunWriter object
+        */
+        RunWriter(int level = 0) : level(level) {}
+
+        /**
+         * @brief Append a record, keys must be added in sorted order
+         *
+         * @param key the key
+         * @param count the value of the key
+        */
+        void add(string_view key, uint64_t count);
+
+        /**
+         * @brief Encode the header and the records and reset the writer
+         *
+         * @return string the bytes of the run
+        */
+        string finish();
+
+        /**
+         * @brief Write the header and the records to a file
+         *
+         * @param filename the file to write
+         * @return true if the file was written
+        */
+        bool write(const string &filename);
+
+        /**
+         * @brief Stream the run to the end of a file instead of holding it,
+         *      for runs larger than memory: add flushes the records in
+         *      chunks and end writes the header in front of them
+         *
+         * @param file the file to append the run to
+        */
+        void begin(AtomicFile *file);
+
+        /**
+         * @brief Flush the last records of a streamed run and write its header
+         *
+         * @return true if the run was written
+        */
+        bool end();
+
+    private:
+        int level;              /**< compression level, 0 for none */
+        string payload;         /**< encoded records */
+        uint64_t records = 0;   /**< number of records added */
+        AtomicFile *file = nullptr;     /**< file of a streamed run */
+        uint64_t start = 0;             /**< offset of a streamed run's header */
+        uint64_t flushed = 0;           /**< stored payload bytes of a streamed run already written */
+        uint64_t checksum = RUN_CHECKSUM_SEED;  /**< checksum of the flushed payload */
+
+        /**
+         * @brief Append the buffered records to the file of a streamed run
+        */
+        void flush();
+};
+
+/**
+ * @brief RunReader class
+ * The RunReader loads a run file with a single read (or takes a run
+ * handed over in memory by the Shuffle), validates it
+ * and iterates over its records. Keys point into the loaded buffer,
+ * so they stay valid for the lifetime of the reader. The records of a
+ * dictionary-encoded run also carry the id of their key. A compressed
+ * run is decoded as a whole once its checksum was checked.
+*/
+class RunReader {
+    public:
+        /**
+         * @brief Load and validate a run file
+         *
+         * @param filename the file to read
+         * @return RunReader the new RunReader object
+        */
+        RunReader(const string &filename);
+
+        /**
+         * @brief Validate a run that is already in memory
+         *
+         * @param bytes the bytes of the run, moved into the reader
+         * @param name the name of the run for error messages
+         * @return RunReader the new RunReader object
+        */
+        RunReader(string &&bytes, const string &name);
+
+        /**
+         * @brief Check if the file was loaded and passed validation
+         *
+         * @return true if the file is a valid run file
+        */
+        bool valid() const;
+
+        /**
+         * @brief Advance to the next record
+         *
+         * @return true if a record was read
+         * @return false at the end of the file
+        */
+        bool next();
+
+        /**
+         * @brief The key of the current record
+        */
+        string_view key() const;
+
+        /**
+         * @brief The count of the current record
+        */
+        uint64_t count() const;
+
+        /**
+         * @brief The size of the run in bytes as stored, header included
+        */
+        size_t size() const;
+
+        /**
+         * @brief Check if the run is dictionary-encoded
+        */
+        bool dictionary() const;
+
+        /**
+         * @brief The dictionary of a dictionary-encoded run, indexed by id
+        */
+        const vector<string_view> &keys() const;
+
+        /**
+         * @brief The key id of the current record of a dictionary-encoded run
+        */
+        uint64_t id() const;
+
+    private:
+        string buffer;              /**< the whole file, with a decoded payload */
+        size_t stored = 0;          /**< bytes of the file */
+        size_t pos = 0;             /**< offset of the next record */
+        bool ok = false;            /**< whether the file is valid */
+        bool encoded = false;       /**< whether the keys are dictionary ids */
+        vector<string_view> dictionary_keys;    /**< the dictionary, pointing into buffer */
+        uint64_t current_id = 0;    /**< key id of the current record */
+        string_view current_key;    /**< key of the current record */
+        uint64_t current_count = 0; /**< count of the current record */
+
+        /**
+         * @brief Check the header and the checksum of the loaded buffer
+         *
+         * @param name the name of the run for error messages
+        */
+        void validate(const string &name);
+};
+
+/**
+ * @brief RunStream class
+ * Reads the records of one run of a file through a buffer of bounded
+ * size, for runs that do not fit in memory. The checksum is computed
+ * as the payload is read and checked once the last record was read.
+ * A compressed run is read and decoded one block at a time.
+*/
+class RunStream {
+    public:
+        /**
+         * @brief Open a run and read its header
+         *
+         * @param filename the file holding the run
+         * @param offset where the run's header starts in the file
+         * @param capacity the bytes buffered at a time
+         * @return RunStream the new RunStream object
+        */
+        RunStream(const string &filename, uint64_t offset, size_t capacity);
+
+        /**
+         * @brief Close the file
+        */
+        ~RunStream();
+
+        RunStream(RunStream &&other);
+        RunStream(const RunStream &) = delete;
+        RunStream &operator=(const RunStream &) = delete;
+
+        /**
+         * @brief Check if the header is valid and, once the run was read
+         *      to its end, the checksum too
+        */
+        bool valid() const;
+
+        /**
+         * @brief Advance to the next record, the key of the previous
+         *      record is no longer valid
+         *
+         * @return true if a record was read
+         * @return false at the end of the run
+        */
+        bool next();
+
+        /**
+         * @brief The key of the current record
+        */
+        string_view key() const;
+
+        /**
+         * @brief The count of the current record
+        */
+        uint64_t count() const;
+
+        /**
+         * @brief The size of the run in bytes as stored, header included
+        */
+        uint64_t size() const;
+
+    private:
+        string name;                /**< the file, for error messages */
+        int fd = -1;                /**< the open file */
+        uint64_t offset = 0;        /**< file offset of the next read */
+        uint64_t remaining = 0;     /**< stored payload bytes not read yet */
+        uint64_t payload = 0;       /**< stored payload bytes of the run */
+        bool compressed = false;    /**< the payload is stored as blocks */
+        string stored;              /**< stored bytes of the block being decoded */
+        uint64_t expected = 0;      /**< checksum from the header */
+        uint64_t checksum = RUN_CHECKSUM_SEED;  /**< checksum of the payload read so far */
+        string buffer;              /**< buffered payload bytes */
+        size_t pos = 0;             /**< offset of the next record in buffer */
+        size_t capacity;            /**< bytes read at a time */
+        bool ok = false;            /**< whether the run is valid so far */
+        string_view current_key;    /**< key of the current record */
+        uint64_t current_count = 0; /**< count of the current record */
+
+        /**
+         * @brief Move the unread bytes to the front of the buffer and read more
+         *
+         * @param need the unread bytes the buffer must hold at least
+         * @return true if the buffer holds at least need unread bytes
+        */
+        bool refill(size_t need);
+
+        /**
+         * @brief Read the next block of a compressed run and append it
+         *      decoded to the buffer
+         *
+         * @return true if the block was valid
+        */
+        bool inflate();
+};
+
+/**
+ * @brief Find the runs of a file
+ *
+ * @param filename the file to scan
+ * @return vector<uint64_t> the offset of each run's header
+*/
+vector<uint64_t> runOffsets(const string &filename);
+
+#endif // RUNFILE_HPP
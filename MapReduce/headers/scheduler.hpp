@@ -0,0 +1,54 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "libraries.hpp"
+
+/**
+ * @brief TaskScheduler class
+ * The TaskScheduler hands out map tasks to a fixed pool of workers.
+ * Each worker owns a deque of task ids and takes work from its front;
+ * a worker whose deque is empty steals from the back of the others,
+ * so no worker sits idle while tasks remain.
+*/
+class TaskScheduler {
+    public:
+        /**
+         * @brief Construct a new TaskScheduler object
+         *      The tasks are dealt round-robin to the workers in the given
+         *      order, so the first tasks start first
+         *
+         * @param nworkers the number of workers
+         * @param tasks the task ids, most expensive first
+         * @return TaskScheduler the new TaskScheduler object
+        */
+        TaskScheduler(int nworkers, const vector<int> &tasks);
+
+        /**
+         * @brief Get the next task for a worker
+         *
+         * @param worker the worker id
+         * @param task the task id
+         * @return true if a task was found
+         * @return false if every queue is empty
+        */
+        bool next(int worker, int &task);
+
+    private:
+        typedef struct WorkQueue {
+            mutex lock;         /**< guards tasks */
+            deque<int> tasks;   /**< pending task ids */
+        } WorkQueue;
+
+        vector<unique_ptr<WorkQueue>> queues;   /**< one queue per worker */
+
+        /**
+         * @brief Steal a task from the back of another worker's queue
+         *
+         * @param worker the worker id of the thief
+         * @param task the stolen task id
+         * @return true if a task was stolen
+        */
+        bool steal(int worker, int &task);
+};
+
+#endif // SCHEDULER_HPP
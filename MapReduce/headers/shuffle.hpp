@@ -0,0 +1,63 @@
+#ifndef SHUFFLE_HPP
+#define SHUFFLE_HPP
+
+#include "libraries.hpp"
+
+/**
+ * @brief Shuffle class
+ * In-process channels that carry encoded partition blocks from the
+ * mappers to the reducers without touching the disk. There is one
+ * channel per reduce partition; every mapper is a producer on all of
+ * them and closes once it has handed over its last block.
+*/
+class Shuffle {
+    public:
+        /**
+         * @brief Construct a new Shuffle object
+         *
+         * @param nreduce the number of reduce partitions
+         * @param nproducers the number of mappers that will close
+         * @param capacity the blocks a channel holds before put waits,
+         *      0 for unbounded
+         * @return Shuffle the new Shuffle object
+        */
+        Shuffle(int nreduce, int nproducers, size_t capacity = 0);
+
+        /**
+         * @brief Hand a block of records to a reducer, waiting for
+         *      room if the channel is bounded and full
+         *
+         * @param part the reduce partition
+         * @param block the encoded records, moved into the channel
+        */
+        void put(int part, string &&block);
+
+        /**
+         * @brief Mark one producer as finished
+        */
+        void close();
+
+        /**
+         * @brief Wait for the next block of a partition
+         *
+         * @param part the reduce partition
+         * @param block the next block
+         * @return true if a block was taken
+         * @return false once every producer closed and the channel is drained
+        */
+        bool take(int part, string &block);
+
+    private:
+        typedef struct Channel {
+            mutex lock;                 /**< guards blocks */
+            condition_variable ready;   /**< signalled on put and close */
+            condition_variable space;   /**< signalled on take */
+            deque<string> blocks;       /**< blocks not taken yet */
+        } Channel;
+
+        vector<unique_ptr<Channel>> channels;   /**< one channel per partition */
+        atomic<int> producers;                  /**< producers still running */
+        size_t capacity;                        /**< max blocks per channel, 0 for unbounded */
+};
+
+#endif // SHUFFLE_HPP
@@ -0,0 +1,270 @@
+#ifndef SKETCH_HPP
+#define SKETCH_HPP
+
+#include "libraries.hpp"
+#include "hashtable.hpp"
+
+/**
+ * Fixed-size summaries of a stream of (key, count) records for the
+ * --approx mode. Every summary is mergeable: merging the summaries of
+ * two streams gives the summary of the concatenated stream, so mappers,
+ * reducers and the master can each merge what the previous stage built.
+ *
+ * A serialized ApproxSketch is a SketchHeader followed by the payload:
+ *
+ *      counters    the Count-Min counters, row by row, as varints
+ *      registers   the HyperLogLog registers, one byte each
+ *      candidates  the candidate count and each candidate as a varint
+ *                  length and the key bytes
+*/
+
+/* counters in each row of a Count-Min sketch, a power of two */
+const size_t SKETCH_WIDTH = 1 << 15;
+
+/* rows of a Count-Min sketch, each indexed by its own hash */
+const size_t SKETCH_DEPTH = 4;
+
+/* bits of the hash that pick a HyperLogLog register */
+const int SKETCH_PRECISION = 14;
+
+/* keys --approx reports without --top-k */
+const uint64_t APPROX_TOP_K = 100;
+
+const char SKETCH_MAGIC[4] = {'M', 'R', 'S', 'K'};
+const uint16_t SKETCH_VERSION = 1;
+
+typedef struct SketchHeader {
+    char magic[4];          /**< SKETCH_MAGIC */
+    uint16_t version;       /**< SKETCH_VERSION */
+    uint16_t depth;         /**< SKETCH_DEPTH of the writer */
+    uint32_t width;         /**< SKETCH_WIDTH of the writer */
+    uint32_t reserved;      /**< 0, so the header has no padding */
+    uint64_t capacity;      /**< candidates the sketch keeps */
+    uint64_t payload;       /**< bytes after the header */
+    uint64_t checksum;      /**< FNV-1a hash of the payload */
+} SketchHeader;
+
+/**
+ * @brief CountMinSketch class
+ * SKETCH_DEPTH rows of SKETCH_WIDTH counters. A record adds its count to
+ * one counter of every row and a key is estimated by the smallest of its
+ * counters, which never undercounts. With probability 1 - e^-depth, the
+ * estimate overcounts by at most e / width times the total count.
+*/
+class CountMinSketch {
+    public:
+        /**
+         * @brief Construct an empty CountMinSketch object
+        */
+        CountMinSketch();
+
+        /**
+         * @brief Add a count to a key
+         *
+         * @param hash the hashKey of the key
+         * @param count the count to add
+        */
+        void add(uint64_t hash, uint64_t count);
+
+        /**
+         * @brief Estimate the total count of a key
+         *
+         * @param hash the hashKey of the key
+        */
+        uint64_t estimate(uint64_t hash) const;
+
+        /**
+         * @brief Add the counters of a sketch of other records
+        */
+        void merge(const CountMinSketch &other);
+
+        /**
+         * @brief The total count of every record added
+        */
+        uint64_t total() const;
+
+        /**
+         * @brief The most an estimate overcounts, with probability confidence
+        */
+        uint64_t bound() const;
+
+        /**
+         * @brief The probability that an estimate is within bound
+        */
+        static double confidence();
+
+        /**
+         * @brief Reset every counter
+        */
+        void clear();
+
+        /**
+         * @brief Append the counters as varints
+        */
+        void encode(string &out) const;
+
+        /**
+         * @brief Read the counters written by encode
+         *
+         * @param in the encoded bytes
+         * @param pos where the counters start, advanced past them
+         * @return true if every counter was read
+        */
+        bool decode(string_view in, size_t &pos);
+
+    private:
+        vector<uint64_t> counters;  /**< the rows, one after the other */
+        uint64_t sum = 0;           /**< total count added */
+
+        /**
+         * @brief The counter of a key in a row
+        */
+        size_t cell(uint64_t hash, size_t row) const;
+};
+
+/**
+ * @brief HyperLogLog class
+ * Estimates the number of distinct keys from 2^SKETCH_PRECISION one-byte
+ * registers, each holding the longest run of leading zeros seen in the
+ * hashes that pick it. The relative standard error is 1.04 / sqrt(2^p).
+*/
+class HyperLogLog {
+    public:
+        /**
+         * @brief Construct an empty HyperLogLog object
+        */
+        HyperLogLog();
+
+        /**
+         * @brief Add a key
+         *
+         * @param hash the hashKey of the key
+        */
+        void add(uint64_t hash);
+
+        /**
+         * @brief Take the larger register of a sketch of other keys
+        */
+        void merge(const HyperLogLog &other);
+
+        /**
+         * @brief Estimate the distinct keys added, with the linear
+         *      counting correction for small sets
+        */
+        double estimate() const;
+
+        /**
+         * @brief The relative standard error of the estimate
+        */
+        static double error();
+
+        /**
+         * @brief Reset every register
+        */
+        void clear();
+
+        /**
+         * @brief Append the registers
+        */
+        void encode(string &out) const;
+
+        /**
+         * @brief Read the registers written by encode
+         *
+         * @param in the encoded bytes
+         * @param pos where the registers start, advanced past them
+         * @return true if every register was read
+        */
+        bool decode(string_view in, size_t &pos);
+
+    private:
+        vector<uint8_t> registers;  /**< the registers */
+};
+
+/**
+ * @brief ApproxSketch class
+ * The summary an --approx job builds instead of exact counts: a
+ * Count-Min sketch of the counts, a HyperLogLog of the distinct keys and
+ * the heavy hitters, the keys whose estimate is among the capacity
+ * highest. A key joins the candidates when its estimate beats the
+ * weakest candidate kept, and once the candidates reach twice the
+ * capacity they are cut back to the capacity ones with the highest
+ * estimates. The memory of a sketch only depends on its capacity.
+*/
+class ApproxSketch {
+    public:
+        /**
+         * @brief Construct an empty ApproxSketch object
+         *
+         * @param capacity the heavy hitters to keep
+         * @return ApproxSketch the new ApproxSketch object
+        */
+        ApproxSketch(size_t capacity = APPROX_TOP_K);
+
+        /**
+         * @brief Add a record
+         *
+         * @param key the key
+         * @param count the count of the record
+        */
+        void add(string_view key, uint64_t count);
+
+        /**
+         * @brief Merge the sketch of other records into this one
+        */
+        void merge(const ApproxSketch &other);
+
+        /**
+         * @brief The candidates with the highest estimates
+         *
+         * @param k the keys to return at most
+         * @return vector<pair<string_view, uint64_t>> keys and estimates
+         *      sorted by estimate and then key, valid until the sketch changes
+        */
+        vector<pair<string_view, uint64_t>> top(size_t k) const;
+
+        /**
+         * @brief The Count-Min sketch of the counts
+        */
+        const CountMinSketch &counts() const;
+
+        /**
+         * @brief The HyperLogLog of the keys
+        */
+        const HyperLogLog &distinct() const;
+
+        /**
+         * @brief Forget every record
+        */
+        void clear();
+
+        /**
+         * @brief Serialize the sketch
+         *
+         * @return string a SketchHeader and its payload
+        */
+        string encode() const;
+
+        /**
+         * @brief Replace the sketch with a serialized one
+         *
+         * @param bytes the output of encode
+         * @param name the file or block, for error messages
+         * @return true if the header, the dimensions and the checksum matched
+        */
+        bool decode(string_view bytes, const string &name);
+
+    private:
+        size_t capacity;            /**< heavy hitters to keep */
+        CountMinSketch cms;         /**< the counts */
+        HyperLogLog hll;            /**< the distinct keys */
+        CountTable candidates;      /**< candidate keys and their last estimates */
+        uint64_t threshold = 0;     /**< estimate a new candidate must beat */
+
+        /**
+         * @brief Keep the capacity candidates with the highest estimates
+        */
+        void prune();
+};
+
+#endif // SKETCH_HPP
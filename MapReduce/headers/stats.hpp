@@ -0,0 +1,99 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include "libraries.hpp"
+#include "options.hpp"
+
+/**
+ * @brief Stopwatch class
+ * Measures the wall time and the CPU time since it was started. The
+ * CPU clock is the calling thread's by default, so a worker measures its
+ * own CPU time even while other workers are running.
+*/
+class Stopwatch {
+    public:
+        /**
+         * @brief Construct a new Stopwatch object and start it
+         *
+         * @param cpu_clock the CPU clock to read, per thread or per process
+         * @return Stopwatch the new Stopwatch object
+        */
+        Stopwatch(clockid_t cpu_clock = CLOCK_THREAD_CPUTIME_ID);
+
+        /**
+         * @brief Milliseconds of wall time since the start
+        */
+        double wallMs() const;
+
+        /**
+         * @brief Milliseconds of CPU time since the start
+        */
+        double cpuMs() const;
+
+    private:
+        clockid_t cpu_clock;                    /**< the CPU clock */
+        chrono::steady_clock::time_point wall;  /**< wall time at the start */
+        double cpu;                             /**< CPU milliseconds at the start */
+};
+
+/**
+ * @brief WorkerStats struct
+ * What one mapper, reducer or the merger did during a phase.
+*/
+typedef struct WorkerStats {
+    int id = 0;                     /**< the worker id */
+    double wall_ms = 0;             /**< wall time of the worker */
+    double cpu_ms = 0;              /**< CPU time of the worker's thread */
+    uint64_t tasks = 0;             /**< map tasks or input blocks processed */
+    uint64_t bytes_read = 0;        /**< input bytes */
+    uint64_t bytes_written = 0;     /**< bytes written to files or the shuffle */
+    uint64_t records_in = 0;        /**< records read */
+    uint64_t records_out = 0;       /**< records emitted or written */
+    uint64_t keys = 0;              /**< distinct keys reduced */
+    uint64_t spills = 0;            /**< runs spilled to disk to stay within the memory budget */
+    vector<uint64_t> partition_records; /**< records emitted per partition, mappers only */
+} WorkerStats;
+
+/**
+ * @brief PhaseStats struct
+ * The wall time of a phase and the stats of its workers.
+*/
+typedef struct PhaseStats {
+    double wall_ms = 0;             /**< wall time of the phase */
+    vector<WorkerStats> workers;    /**< one entry per worker */
+} PhaseStats;
+
+/**
+ * @brief JobStats struct
+ * Everything measured during one job. Phases have fixed slots so the
+ * pipelined map and reduce phases can fill them concurrently.
+*/
+typedef struct JobStats {
+    double wall_ms = 0;     /**< wall time of the job */
+    double cpu_ms = 0;      /**< CPU time of the process during the job */
+    PhaseStats map;         /**< the map phase */
+    PhaseStats reduce;      /**< the reduce phase */
+    PhaseStats merge;       /**< the merge phase */
+    uint64_t backups = 0;   /**< backup task copies launched */
+    uint64_t backups_won = 0;   /**< backup copies that finished before the original */
+    uint64_t cached_files = 0;  /**< input files whose map output came from the map cache */
+    uint64_t rounds = 0;        /**< map rounds of a watch, the map phase is the last one */
+    uint64_t snapshots = 0;     /**< output.txt snapshots a watch published */
+    double distinct_keys = 0;   /**< HyperLogLog estimate of the distinct keys, with approx */
+    uint64_t overcount = 0;     /**< largest error bound of a reported estimate, with approx */
+} JobStats;
+
+/**
+ * @brief Write a job report as JSON
+ *      Besides the raw phase and worker stats, the report holds the
+ *      records of each partition summed over the mappers, the distinct
+ *      keys of each reducer and their skew (max / mean)
+ *
+ * @param stats the measured job
+ * @param options the options of the job
+ * @param filename the file to write
+ * @return true if the report was written
+*/
+bool writeJobStats(const JobStats &stats, const Options &options, const string &filename);
+
+#endif // STATS_HPP
@@ -0,0 +1,170 @@
+#ifndef TOKENIZER_HPP
+#define TOKENIZER_HPP
+
+#include "libraries.hpp"
+
+/**
+ * @brief ByteClasses struct
+ * Bitmasks that classify a 64-byte block of input, bit i for byte i.
+*/
+typedef struct ByteClasses {
+    uint64_t delim;     /**< space, newline, comma or apostrophe */
+    uint64_t reject;    /**< neither a delimiter nor a latin letter */
+    uint64_t upper;     /**< uppercase latin letter */
+} ByteClasses;
+
+/**
+ * @brief A kernel that classifies the 64 bytes starting at p
+*/
+typedef void (*ClassifyKernel)(const char *p, ByteClasses &classes);
+
+/**
+ * @brief Classify 64 bytes one byte at a time
+*/
+void classifyScalar(const char *p, ByteClasses &classes);
+
+/**
+ * @brief Classify 64 bytes as four SSE4.2 vectors of 16 bytes
+*/
+void classifySSE42(const char *p, ByteClasses &classes);
+
+/**
+ * @brief Classify 64 bytes as two AVX2 vectors of 32 bytes
+*/
+void classifyAVX2(const char *p, ByteClasses &classes);
+
+/**
+ * @brief Pick the widest classify kernel the CPU supports
+ *
+ * @return ClassifyKernel the AVX2, SSE4.2 or scalar kernel
+*/
+ClassifyKernel bestClassifyKernel();
+
+/**
+ * @brief Tokenizer class
+ * The Tokenizer splits raw input bytes into lowercase latin words
+ * without copying the input. A space ends a word (even an empty one),
+ * a newline ends a non-empty word, and words are further split around
+ * commas and apostrophes. Words with any other non-latin character are
+ * ignored. Emitted words point into the input unless they had to be
+ * lowercased, in which case they point into a reused scratch buffer.
+ *
+ * The input is classified 64 bytes at a time by a SIMD kernel chosen
+ * at runtime, and words are found by walking the delimiter bitmask.
+*/
+class Tokenizer {
+    public:
+        /**
+         * @brief Construct a new Tokenizer object
+         *
+         * @param kernel the classify kernel, nullptr for the best supported one
+         * @return Tokenizer the new Tokenizer object
+        */
+        Tokenizer(ClassifyKernel kernel = nullptr) {
+            this->kernel = kernel ? kernel : bestClassifyKernel();
+        }
+
+        /**
+         * @brief Tokenize a block of text
+         *
+         * @param text the bytes to tokenize
+         * @param emit called with each lowercase word as a string_view
+        */
+        template <typename Emit>
+        void tokenize(string_view text, Emit &&emit) {
+            const char *p = text.data();
+            size_t n = text.size();
+            size_t start = 0;       // first byte of the current piece
+            bool bad = false;       // current piece has a rejected byte before this block
+            bool upper = false;     // current piece has an uppercase letter before this block
+
+            for (size_t base = 0; base < n; base += 64) {
+                ByteClasses c;
+                if (n - base >= 64) {
+                    this->kernel(p + base, c);
+                } else {
+                    char tail[64] = {0};
+                    memcpy(tail, p + base, n - base);
+                    this->kernel(tail, c);
+                    uint64_t valid = (1ULL << (n - base)) - 1;
+                    c.delim &= valid;
+                    c.reject &= valid;
+                    c.upper &= valid;
+                }
+
+                for (uint64_t d = c.delim; d; d &= d - 1) {
+                    int bit = __builtin_ctzll(d);
+                    uint64_t before = (1ULL << bit) - 1;
+                    uint64_t through = (2ULL << bit) - 1;
+                    size_t end = base + bit;
+
+                    if (!bad && !(c.reject & before)) {
+                        string_view piece(p + start, end - start);
+                        bool lower = !upper && !(c.upper & before);
+                        if (!piece.empty()) {
+                            emit(lower ? piece : this->lower(piece));
+                        } else if (p[end] == ' ' &&
+                            (start == 0 || p[start - 1] == ' ' || p[start - 1] == '\n')
+                        ) {
+                            // a space after a space or a line start is an empty word
+                            emit(piece);
+                        }
+                    }
+
+                    c.reject &= ~through;
+                    c.upper &= ~through;
+                    bad = upper = false;
+                    start = end + 1;
+                }
+
+                bad |= c.reject != 0;
+                upper |= c.upper != 0;
+            }
+
+            if (n > start && !bad) {
+                string_view piece(p + start, n - start);
+                emit(upper ? this->lower(piece) : piece);
+            }
+        }
+
+        /**
+         * @brief Align a byte range of a file to word boundaries
+         *      A range owns every word that starts inside it, so the start
+         *      moves forward and the end moves past the word it cuts, both
+         *      to the next position that follows a space or a newline.
+         *      Tokenizing the aligned ranges of consecutive splits gives
+         *      exactly the words of the whole file.
+         *
+         * @param text the whole file
+         * @param begin the first byte of the range
+         * @param end one past the last byte of the range
+         * @return string_view the aligned range
+        */
+        static string_view align(string_view text, size_t begin, size_t end) {
+            auto cut = [&text](size_t p) {
+                while (p < text.size() && text[p - 1] != ' ' && text[p - 1] != '\n') p++;
+                return min(p, text.size());
+            };
+            size_t from = begin == 0 ? 0 : cut(begin);
+            size_t to = end >= text.size() ? text.size() : cut(end);
+            return from < to ? text.substr(from, to - from) : string_view();
+        }
+
+    private:
+        ClassifyKernel kernel;  /**< classifies 64-byte blocks */
+        string scratch;         /**< buffer for words that need lowercasing */
+
+        /**
+         * @brief Lowercase a latin word into the scratch buffer
+         *
+         * @param w the word to lowercase
+         * @return string_view the lowercase word
+        */
+        string_view lower(string_view w) {
+            this->scratch.assign(w.data(), w.size());
+            for (char &c : this->scratch) c |= 0x20;
+            return this->scratch;
+        }
+};
+
+#endif // TOKENIZER_HPP
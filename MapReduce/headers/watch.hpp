@@ -0,0 +1,66 @@
+#ifndef WATCH_HPP
+#define WATCH_HPP
+
+#include "libraries.hpp"
+
+/**
+ * @brief DirectoryWatch class
+ * Reports the .txt files of a directory that were written to, created or
+ * moved in, with inotify. The first SIGINT or SIGTERM after the watch is
+ * created stops it instead of killing the process, so the caller can
+ * publish what it has before it exits.
+*/
+class DirectoryWatch {
+    public:
+        /**
+         * @brief Start watching a directory
+         *
+         * @param dir the directory to watch
+         * @return DirectoryWatch the new DirectoryWatch object
+        */
+        DirectoryWatch(const string &dir);
+
+        /**
+         * @brief Stop watching and restore the signal handlers
+        */
+        ~DirectoryWatch();
+
+        DirectoryWatch(const DirectoryWatch &) = delete;
+        DirectoryWatch &operator=(const DirectoryWatch &) = delete;
+
+        /**
+         * @brief Check if inotify is watching the directory
+        */
+        bool valid() const;
+
+        /**
+         * @brief Check if SIGINT or SIGTERM asked the watch to stop
+        */
+        bool stopped() const;
+
+        /**
+         * @brief Collect the files changed during the next milliseconds
+         *      If the kernel dropped events, every .txt file of the
+         *      directory is reported
+         *
+         * @param timeout_ms how long to collect events
+         * @param changed the paths of the changed files
+         * @return false if the watch was stopped or failed
+        */
+        bool wait(uint64_t timeout_ms, unordered_set<string> &changed);
+
+        /**
+         * @brief List the .txt files of the directory, sorted by path
+         *
+         * @param dir the directory
+         * @return vector<string> the paths of the files
+        */
+        static vector<string> listFiles(const string &dir);
+
+    private:
+        string dir;             /**< the watched directory */
+        int fd = -1;            /**< the inotify instance */
+        vector<char> events;    /**< buffer the events are read into */
+};
+
+#endif // WATCH_HPP
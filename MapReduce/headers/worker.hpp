@@ -0,0 +1,86 @@
+#ifndef WORKER_HPP
+#define WORKER_HPP
+
+#include "libraries.hpp"
+#include "mapper.hpp"
+#include "options.hpp"
+#include "partitioner.hpp"
+#include "rpc.hpp"
+
+/**
+ * @brief Worker class
+ * The main loop of a worker process (./mapreduce --worker <socket>).
+ * The worker connects to the master, receives the job, then runs one
+ * map or reduce task at a time and reports each with its stats, until
+ * the master has no tasks left. A second thread sends heartbeats so the
+ * master can tell a slow task from a hung or dead worker.
+*/
+class Worker {
+    public:
+        /**
+         * @brief Construct a new Worker object
+         *
+         * @param socket_path the socket the master listens on
+         * @return Worker the new Worker object
+        */
+        Worker(const string &socket_path);
+
+        /**
+         * @brief Run tasks until the master sends EXIT or goes away
+         *
+         * @return int the exit status of the process
+        */
+        int run();
+
+    private:
+        string socket_path;         /**< the socket the master listens on */
+        Connection connection;      /**< the connection to the master */
+        mutex send_lock;            /**< serializes sends of the two threads */
+        mutex stop_lock;            /**< guards stopping */
+        condition_variable stop;    /**< wakes the heartbeat thread to exit */
+        bool stopping = false;      /**< set when the worker exits */
+        Options options;            /**< the job options */
+        vector<string> files;       /**< the input files */
+        vector<MapTask> tasks;      /**< the map tasks over the files */
+        Partitioner partitioner;    /**< assigns keys to reduce partitions */
+
+        /**
+         * @brief Send a message to the master from either thread
+        */
+        bool send(const Message &message);
+
+        /**
+         * @brief Decode the job sent by the master
+         *
+         * @param message the MSG_JOB message
+         * @return true if the job was decoded
+        */
+        bool readJob(Message &message);
+
+        /**
+         * @brief Send a heartbeat every interval until the worker stops
+        */
+        void heartbeat();
+
+        /**
+         * @brief Run a map task
+         *
+         * @tparam Job the job to map
+         * @param task the index of the task
+         * @return WorkerStats the stats of the task
+        */
+        template <typename Job>
+        WorkerStats mapTask(int task);
+
+        /**
+         * @brief Run a reduce task
+         *
+         * @tparam Job the job to reduce
+         * @param part the reduce partition
+         * @return WorkerStats the stats of the task
+        */
+        template <typename Job>
+        WorkerStats reduceTask(int part);
+};
+
+#endif // WORKER_HPP
@@ -0,0 +1,66 @@
+#include "headers.hpp"
+
+InputFile::InputFile(const string &path) {
+    this->bytes = nullptr;
+    this->length = 0;
+    this->mapped = false;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Could not open input file: " << path << endl;
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        !S_ISREG(st.st_mode) ||
+        st.st_size == 0 ||
+        !this->mapFile(fd, st.st_size)
+    ) {
+        this->readFile(fd);
+    }
+    close(fd);
+}
+
+InputFile::~InputFile() {
+    if (this->mapped) {
+        munmap((void *) this->bytes, this->length);
+    }
+}
+
+string_view InputFile::data() const {
+    return string_view(this->bytes, this->length);
+}
+
+bool InputFile::isMapped() const {
+    return this->mapped;
+}
+
+bool InputFile::mapFile(int fd, size_t size) {
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    // the tokenizer makes a single forward pass over the file
+    madvise(addr, size, MADV_SEQUENTIAL);
+
+    this->bytes = (const char *) addr;
+    this->length = size;
+    this->mapped = true;
+    return true;
+}
+
+void InputFile::readFile(int fd) {
+    char chunk[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        this->buffer.append(chunk, n);
+    }
+    this->bytes = this->buffer.data();
+    this->length = this->buffer.size();
+}
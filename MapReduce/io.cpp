@@ -0,0 +1,364 @@
+#include "headers.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/* submission queue entries of a ring, the completion queue has twice as many */
+const unsigned IO_ENTRIES = 64;
+
+/* tag bit of a write, reads and writes are tagged with their buffer index */
+const uint64_t IO_WRITE = 1ULL << 63;
+
+IoEngine::IoEngine(IoMode mode) {
+    this->storage.resize(IO_DEPTH * (IO_HEADROOM + IO_CHUNK) + IO_DEPTH * IO_CHUNK);
+    this->buffers.resize(IO_DEPTH);
+    this->writes.resize(IO_DEPTH);
+    char *outgoing = this->storage.data() + IO_DEPTH * (IO_HEADROOM + IO_CHUNK);
+    for (size_t i = 0; i < IO_DEPTH; i++) {
+        this->buffers[i].data = this->storage.data() + i * (IO_HEADROOM + IO_CHUNK) + IO_HEADROOM;
+        this->writes[i].data = outgoing + i * IO_CHUNK;
+        this->idle.push_back(i);
+    }
+
+    if (mode == IO_URING && !this->setup()) {
+        static once_flag warned;
+        call_once(warned, [] {
+            cerr << "io_uring is not available, reading with pread and readahead" << endl;
+        });
+    }
+}
+
+IoEngine::~IoEngine() {
+    this->settle();
+    this->drain();
+    if (this->fd >= 0) close(this->fd);
+    if (this->ring < 0) return;
+
+    munmap(this->sqes, this->entries * sizeof(io_uring_sqe));
+    if (this->cq_ring != this->sq_ring) munmap(this->cq_ring, this->cq_size);
+    munmap(this->sq_ring, this->sq_size);
+    close(this->ring);
+}
+
+bool IoEngine::setup() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring = syscall(__NR_io_uring_setup, IO_ENTRIES, &params);
+    if (ring < 0) return false;
+
+    this->entries = params.sq_entries;
+    this->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) this->sq_size = this->cq_size = max(this->sq_size, this->cq_size);
+
+    void *sq = mmap(nullptr, this->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    void *cq = single ? sq : mmap(nullptr, this->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+    void *sqes = mmap(nullptr, this->entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        if (sqes != MAP_FAILED) munmap(sqes, this->entries * sizeof(io_uring_sqe));
+        if (cq != MAP_FAILED && cq != sq) munmap(cq, this->cq_size);
+        if (sq != MAP_FAILED) munmap(sq, this->sq_size);
+        close(ring);
+        return false;
+    }
+
+    this->ring = ring;
+    this->sq_ring = sq;
+    this->cq_ring = cq;
+    this->sqes = sqes;
+    this->sq_tail = (unsigned *) ((char *) sq + params.sq_off.tail);
+    this->sq_mask = (unsigned *) ((char *) sq + params.sq_off.ring_mask);
+    this->sq_array = (unsigned *) ((char *) sq + params.sq_off.array);
+    this->cq_head = (unsigned *) ((char *) cq + params.cq_off.head);
+    this->cq_tail = (unsigned *) ((char *) cq + params.cq_off.tail);
+    this->cq_mask = (unsigned *) ((char *) cq + params.cq_off.ring_mask);
+    this->cqes = (char *) cq + params.cq_off.cqes;
+
+    // registered buffers are pinned once instead of on every read, but count against RLIMIT_MEMLOCK
+    // the read buffers have indices 0 to IO_DEPTH - 1, the write buffers follow
+    vector<iovec> iovecs(2 * IO_DEPTH);
+    for (size_t i = 0; i < IO_DEPTH; i++) {
+        iovecs[i].iov_base = this->buffers[i].data;
+        iovecs[i].iov_len = IO_CHUNK;
+        iovecs[IO_DEPTH + i].iov_base = this->writes[i].data;
+        iovecs[IO_DEPTH + i].iov_len = IO_CHUNK;
+    }
+    this->registered = syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size()) == 0;
+    return true;
+}
+
+bool IoEngine::uring() const {
+    return this->ring >= 0;
+}
+
+bool IoEngine::open(const string &path, uint64_t begin, uint64_t end) {
+    // the buffers of the previous range may still be read into
+    this->settle();
+    this->order.clear();
+    this->current = -1;
+    if (this->fd >= 0) close(this->fd);
+
+    this->path = path;
+    this->cursor = begin;
+    this->end = end;
+    this->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (this->fd < 0) {
+        cerr << "Could not open input file: " << path << endl;
+        return false;
+    }
+
+    if (this->ring < 0) {
+        posix_fadvise(this->fd, begin, min<uint64_t>(end - begin, IO_DEPTH * IO_CHUNK), POSIX_FADV_WILLNEED);
+        return true;
+    }
+    for (size_t i = 0; i < IO_DEPTH && this->cursor < this->end; i++) {
+        this->submitRead(i);
+    }
+    this->enter(0);
+    return true;
+}
+
+bool IoEngine::next(char *&data, size_t &length) {
+    if (this->fd < 0) return false;
+
+    if (this->ring < 0) {
+        if (this->cursor >= this->end) return false;
+        ReadBuffer &buffer = this->buffers[0];
+        size_t want = min<uint64_t>(IO_CHUNK, this->end - this->cursor);
+        size_t done = 0;
+        while (done < want) {
+            ssize_t n = pread(this->fd, buffer.data + done, want - done, this->cursor + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
+        }
+        if (done == 0) {
+            this->cursor = this->end;
+            return false;
+        }
+
+        // the kernel reads the chunk after the readahead window while this one is mapped
+        this->cursor += done;
+        uint64_t ahead = this->cursor + (IO_DEPTH - 1) * IO_CHUNK;
+        if (ahead < this->end) {
+            posix_fadvise(this->fd, ahead, min<uint64_t>(IO_CHUNK, this->end - ahead), POSIX_FADV_WILLNEED);
+        }
+        data = buffer.data;
+        length = done;
+        return true;
+    }
+
+    // the chunk handed out last is done with, so its buffer reads the next one
+    if (this->current >= 0 && this->cursor < this->end) {
+        this->submitRead(this->current);
+        this->enter(0);
+    }
+    this->current = -1;
+    if (this->order.empty()) return false;
+
+    int i = this->order.front();
+    this->order.pop_front();
+    ReadBuffer &buffer = this->buffers[i];
+    while (!buffer.done) this->enter(1);
+    if (buffer.result < 0) {
+        cerr << "Could not read input file: " << this->path << ": " << strerror(-buffer.result) << endl;
+        return false;
+    }
+
+    // a short read is finished synchronously, the reads after it are already in flight
+    size_t done = buffer.result;
+    while (done > 0 && done < buffer.length) {
+        ssize_t n = pread(this->fd, buffer.data + done, buffer.length - done, buffer.offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    this->current = i;
+    data = buffer.data;
+    length = done;
+    return done > 0;
+}
+
+void IoEngine::write(int fd, uint64_t offset, string_view bytes, bool *ok) {
+    if (this->ring < 0) {
+        size_t done = 0;
+        while (*ok && done < bytes.size()) {
+            ssize_t n = pwrite(fd, bytes.data() + done, bytes.size() - done, offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) *ok = false;
+            else done += n;
+        }
+        return;
+    }
+
+    // a block larger than a buffer is copied in while its first chunks are written
+    for (size_t first = 0; first < bytes.size() && *ok; first += IO_CHUNK) {
+        while (this->idle.empty()) this->enter(1);
+        int i = this->idle.back();
+        this->idle.pop_back();
+
+        WriteSlot &slot = this->writes[i];
+        slot.fd = fd;
+        slot.offset = offset + first;
+        slot.length = min(IO_CHUNK, bytes.size() - first);
+        slot.written = 0;
+        slot.ok = ok;
+        memcpy(slot.data, bytes.data() + first, slot.length);
+        this->submitWrite(i);
+        this->enter(0);
+    }
+}
+
+void IoEngine::drain() {
+    while (this->idle.size() < IO_DEPTH) this->enter(1);
+}
+
+void IoEngine::submitRead(int i) {
+    ReadBuffer &buffer = this->buffers[i];
+    buffer.offset = this->cursor;
+    buffer.length = min<uint64_t>(IO_CHUNK, this->end - this->cursor);
+    buffer.done = false;
+    this->cursor += buffer.length;
+    this->order.push_back(i);
+
+    io_uring_sqe *sqe = (io_uring_sqe *) this->entry();
+    sqe->opcode = this->registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = this->fd;
+    sqe->off = buffer.offset;
+    sqe->addr = (uint64_t) buffer.data;
+    sqe->len = buffer.length;
+    sqe->buf_index = this->registered ? i : 0;
+    sqe->user_data = i;
+}
+
+void IoEngine::submitWrite(int i) {
+    WriteSlot &slot = this->writes[i];
+    io_uring_sqe *sqe = (io_uring_sqe *) this->entry();
+    sqe->opcode = this->registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = slot.fd;
+    sqe->off = slot.offset + slot.written;
+    sqe->addr = (uint64_t) (slot.data + slot.written);
+    sqe->len = slot.length - slot.written;
+    sqe->buf_index = this->registered ? IO_DEPTH + i : 0;
+    sqe->user_data = IO_WRITE | i;
+}
+
+void *IoEngine::entry() {
+    // the completion queue cannot overflow while at most entries are in flight
+    while (this->inflight >= this->entries) this->enter(1);
+    unsigned tail = *this->sq_tail;
+    unsigned index = tail & *this->sq_mask;
+    io_uring_sqe *sqe = (io_uring_sqe *) this->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    this->sq_array[index] = index;
+    __atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    this->inflight++;
+    this->pending++;
+    return sqe;
+}
+
+void IoEngine::enter(unsigned wait) {
+    if (this->failed) {
+        this->finish();
+        return;
+    }
+    if (this->pending || wait) {
+        int n = syscall(__NR_io_uring_enter, this->ring, this->pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (n >= 0) this->pending -= min<unsigned>(n, this->pending);
+        else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            // no completion would ever come, so the callers waiting for one would spin
+            cerr << "io_uring_enter failed, finishing with pread and pwrite: " << strerror(errno) << endl;
+            this->fail();
+            return;
+        }
+    }
+
+    unsigned head = *this->cq_head;
+    while (head != __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE)) {
+        io_uring_cqe *cqe = (io_uring_cqe *) this->cqes + (head & *this->cq_mask);
+        uint64_t tag = cqe->user_data;
+        int32_t result = cqe->res;
+        head++;
+        __atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+        this->inflight--;
+        this->complete(tag, result);
+    }
+}
+
+void IoEngine::fail() {
+    // the chunk handed out keeps pointing into the retired storage until the next one
+    this->retired.swap(this->storage);
+    this->storage = this->retired;
+    char *from = this->retired.data(), *to = this->storage.data();
+    for (ReadBuffer &buffer : this->buffers) buffer.data = to + (buffer.data - from);
+    for (WriteSlot &slot : this->writes) slot.data = to + (slot.data - from);
+
+    this->failed = true;
+    this->finish();
+}
+
+void IoEngine::finish() {
+    for (int i : this->order) {
+        ReadBuffer &buffer = this->buffers[i];
+        if (buffer.done) continue;
+        size_t done = 0;
+        ssize_t n = 0;
+        while (done < buffer.length) {
+            n = pread(this->fd, buffer.data + done, buffer.length - done, buffer.offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
+        }
+        buffer.result = n < 0 && done == 0 ? -errno : done;
+        buffer.done = true;
+    }
+
+    for (size_t i = 0; i < IO_DEPTH; i++) {
+        if (find(this->idle.begin(), this->idle.end(), i) != this->idle.end()) continue;
+        WriteSlot &slot = this->writes[i];
+        while (*slot.ok && slot.written < slot.length) {
+            ssize_t n = pwrite(slot.fd, slot.data + slot.written, slot.length - slot.written, slot.offset + slot.written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) *slot.ok = false;
+            else slot.written += n;
+        }
+        this->idle.push_back(i);
+    }
+    this->inflight = this->pending = 0;
+}
+
+void IoEngine::complete(uint64_t tag, int32_t result) {
+    if (!(tag & IO_WRITE)) {
+        ReadBuffer &buffer = this->buffers[tag];
+        buffer.result = result;
+        buffer.done = true;
+        return;
+    }
+
+    int i = tag & ~IO_WRITE;
+    WriteSlot &slot = this->writes[i];
+    if (result == -EINTR || result == -EAGAIN) {
+        this->submitWrite(i);
+        return;
+    }
+    if (result <= 0) {
+        *slot.ok = false;
+        this->idle.push_back(i);
+        return;
+    }
+    slot.written += result;
+    if (slot.written < slot.length) {
+        this->submitWrite(i);
+        return;
+    }
+    this->idle.push_back(i);
+}
+
+void IoEngine::settle() {
+    if (this->ring < 0) return;
+    for (int i : this->order) {
+        while (!this->buffers[i].done) this->enter(1);
+    }
+}
@@ -1,16 +1,113 @@
 #include "headers.hpp"
 
-vector<string> getParams(int argc, char* argv[]) {
-    vector<string> args{4};
+void setOption(Options &options, const string &flag, const string &value) {
+    if (flag == "--input") options.input_dir = value;
+    else if (flag == "--output") options.output_dir = value;
+    else if (flag == "--nworkers") options.nworkers = stoi(value);
+    else if (flag == "--nreduce") options.nreduce = stoi(value);
+    else if (flag == "--combine") options.combine = true;
+    else if (flag == "--text-intermediate") options.text_intermediate = true;
+    else if (flag == "--dictionary") options.dictionary = true;
+    else if (flag == "--compress") options.compress = max(options.compress, COMPRESS_DEFAULT_LEVEL);
+    else if (flag == "--compress-level") {
+        options.compress = stoi(value);
+        if (options.compress < 1 || options.compress > COMPRESS_MAX_LEVEL) {
+            throw invalid_argument("invalid compression level: " + value);
+        }
+    }
+    else if (flag == "--pipeline") {
+        options.pipeline = true;
+        options.shuffle = SHUFFLE_MEMORY;
+    }
+    else if (flag == "--approx") options.approx = true;
+    else if (flag == "--watch") {
+        options.watch = true;
+        options.shuffle = SHUFFLE_MEMORY;
+    }
+    else if (flag == "--watch-interval") options.watch_interval = max<uint64_t>(stoull(value), 1);
+    else if (flag == "--processes") options.processes = true;
+    else if (flag == "--worker-timeout") options.worker_timeout = stoull(value);
+    else if (flag == "--no-backup-tasks") options.backup_tasks = false;
+    else if (flag == "--incremental") options.incremental = true;
+    else if (flag == "--rebuild") options.incremental = options.rebuild = true;
+    else if (flag == "--split-size") options.split_size = parseSize(value);
+    else if (flag == "--memory-budget") options.memory_budget = parseSize(value);
+    else if (flag == "--top-k") options.top_k = stoull(value);
+    else if (flag == "--job") {
+        if (value == "wordcount") options.job = JOB_WORDCOUNT;
+        else if (value == "bigrams") options.job = JOB_BIGRAMS;
+        else throw invalid_argument("invalid job: " + value);
+    }
+    else if (flag == "--partition") {
+        if (value == "poly") options.partition = PARTITION_POLY;
+        else if (value == "wyhash") options.partition = PARTITION_WYHASH;
+        else if (value == "range") options.partition = PARTITION_RANGE;
+        else throw invalid_argument("invalid partitioner: " + value);
+    }
+    else if (flag == "--shuffle") {
+        if (value == "file") options.shuffle = SHUFFLE_FILE;
+        else if (value == "memory") options.shuffle = SHUFFLE_MEMORY;
+        else throw invalid_argument("invalid shuffle mode: " + value);
+    }
+    else if (flag == "--io") {
+        if (value == "mmap") options.io = IO_MMAP;
+        else if (value == "uring") options.io = IO_URING;
+        else if (value == "pread") options.io = IO_PREAD;
+        else throw invalid_argument("invalid io mode: " + value);
+    }
+}
+
+/* a value that does not parse ends the program like an unknown flag */
+void parseOption(Options &options, const string &flag, const string &value, const string &usage) {
+    try {
+        setOption(options, flag, value);
+    } catch (const invalid_argument &) {
+        cout << "Invalid value for flag " << flag << ": " << value << endl;
+        cout << usage << endl;
+        exit(1);
+    } catch (const out_of_range &) {
+        cout << "Value out of range for flag " << flag << ": " << value << endl;
+        cout << usage << endl;
+        exit(1);
+    }
+}
+
+Options getParams(int argc, char* argv[]) {
+    Options options;
 
     vector<string> flags = {
         "--input",
         "--output",
         "--nworkers",
         "--nreduce",
+        "--split-size",
+        "--shuffle",
+        "--io",
+        "--top-k",
+        "--job",
+        "--partition",
+        "--worker-timeout",
+        "--memory-budget",
+        "--compress-level",
+        "--watch-interval",
     };
 
-    string usage = "Usage: ./mapreduce --input <input_file> --output <output_file> --nworkers <nworkers> --nreduce <nreduce>";
+    /* flags that take no value */
+    vector<string> switches = {
+        "--combine",
+        "--text-intermediate",
+        "--dictionary",
+        "--compress",
+        "--pipeline",
+        "--processes",
+        "--no-backup-tasks",
+        "--incremental",
+        "--rebuild",
+        "--approx",
+        "--watch",
+    };
+
+    string usage = "Usage: ./mapreduce --input <input_file> --output <output_file> --nworkers <nworkers> --nreduce <nreduce> [--job <wordcount|bigrams>] [--partition <poly|wyhash|range>] [--split-size <bytes>[K|M|G]] [--memory-budget <bytes>[K|M|G]] [--shuffle <file|memory>] [--io <mmap|uring|pread>] [--top-k <n>] [--combine] [--text-intermediate] [--dictionary] [--compress [--compress-level <1-9>]] [--pipeline] [--incremental [--rebuild]] [--approx] [--watch [--watch-interval <ms>]] [--processes [--worker-timeout <ms>] [--no-backup-tasks]]\n       ./mapreduce --worker <socket>";
 
     for (int i = 1; i < argc; i++) {
         string arg = argv[i];
@@ -21,6 +118,25 @@ vector<string> getParams(int argc, char* argv[]) {
             exit(1);
         }
 
+        /* --flag=value is the same as --flag value */
+        size_t equals = arg.find('=');
+        if (equals != string::npos) {
+            string value = arg.substr(equals + 1);
+            arg = arg.substr(0, equals);
+            if (find(flags.begin(), flags.end(), arg) == flags.end()) {
+                cout << "Invalid flag: " << arg << endl;
+                cout << usage << endl;
+                exit(1);
+            }
+            parseOption(options, arg, value, usage);
+            continue;
+        }
+
+        if (find(switches.begin(), switches.end(), arg) != switches.end()) {
+            parseOption(options, arg, "", usage);
+            continue;
+        }
+
         auto it = find(flags.begin(), flags.end(), arg);
         if (it == flags.end()) {
             cout << "Invalid flag: " << arg << endl;
@@ -28,7 +144,6 @@ vector<string> getParams(int argc, char* argv[]) {
             exit(1);
         }
 
-        int index = distance(flags.begin(), it);
         i++;
         if (i >= argc) {
             cout << "Missing value for flag: " << arg << endl;
@@ -36,10 +151,10 @@ vector<string> getParams(int argc, char* argv[]) {
             exit(1);
         }
 
-        args[index] = argv[i];
+        parseOption(options, arg, argv[i], usage);
     }
 
-    return args;
+    return options;
 }
 
 bool isDir(string path) {
@@ -63,24 +178,66 @@ bool makeDir(string path) {
 
 int main (int argc, char*argv[]) {
 
-    vector<string> args = getParams(argc, argv);
+    /* a worker process started by the master, or joining it */
+    if (argc == 3 && string(argv[1]) == "--worker") {
+        Worker worker(argv[2]);
+        return worker.run();
+    }
+
+    Options options = getParams(argc, argv);
 
-    string input_dir = args[0];
-    string output_dir = args[1];
-    int nworkers = stoi(args[2]);
-    int nreduce = stoi(args[3]);
+    if (options.approx && (options.combine || options.text_intermediate || options.dictionary || options.compress ||
+        options.memory_budget || options.incremental || options.watch)) {
+        cout << "--approx writes fixed-size sketches instead of records, it cannot be used with --combine, --text-intermediate, --dictionary, --compress, --memory-budget, --incremental or --watch" << endl;
+        return 1;
+    }
+    if (options.approx && !options.top_k) {
+        options.top_k = APPROX_TOP_K;
+    }
+
+    if (options.watch && (options.processes || options.pipeline || options.incremental || options.memory_budget)) {
+        cout << "--watch keeps its counts in reducers fed through the memory shuffle, it cannot be used with --processes, --pipeline, --incremental or --memory-budget" << endl;
+        return 1;
+    }
+    if (options.watch && options.partition == PARTITION_RANGE) {
+        cout << "--watch starts before its input arrives, so there is nothing to sample key ranges from, it cannot be used with --partition range" << endl;
+        return 1;
+    }
+
+    if (options.processes && options.shuffle == SHUFFLE_MEMORY) {
+        cout << "--processes needs the file shuffle, it cannot be used with --shuffle memory or --pipeline" << endl;
+        return 1;
+    }
 
-    if (!isDir(input_dir)) {
-        cout << "Invalid input directory: " << input_dir << endl;
+    if (options.memory_budget && (options.text_intermediate || options.shuffle == SHUFFLE_MEMORY)) {
+        cout << "--memory-budget spills binary runs to map.part files, it cannot be used with --text-intermediate, --shuffle memory or --pipeline" << endl;
         return 1;
     }
 
-    if (!makeDir(output_dir)) {
-        cout << "Could not create output directory: " << output_dir << endl;
+    if (options.dictionary && (options.text_intermediate || options.memory_budget)) {
+        cout << "--dictionary encodes binary runs that are reduced in memory, it cannot be used with --text-intermediate or --memory-budget" << endl;
         return 1;
     }
 
-    Master master(input_dir, output_dir, nworkers, nreduce);
+    if (options.compress && options.text_intermediate) {
+        cout << "--compress writes binary runs and compressed reduce.part files, it cannot be used with --text-intermediate" << endl;
+        return 1;
+    }
+
+    if (!isDir(options.input_dir)) {
+        cout << "Invalid input directory: " << options.input_dir << endl;
+        return 1;
+    }
+
+    if (!makeDir(options.output_dir)) {
+        cout << "Could not create output directory: " << options.output_dir << endl;
+        return 1;
+    }
+
+    Master master(options.processes ? 0 : options.nworkers + options.nreduce);
+    if (!master.run(options)) {
+        return 1;
+    }
 
     return 0;
 }
\ No newline at end of file
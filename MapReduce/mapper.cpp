@@ -1,110 +1,382 @@
 #include "headers.hpp"
 
-Mapper::Mapper(int id, string input_dir, string output_dir, int start, int end, int nreduce, vector<string> *files) {
+/* size of a pipelined partition chunk before it is handed to its reducer */
+const size_t PIPELINE_CHUNK = 1 << 20;
+
+/* distinct keys a pipelined combiner holds per partition before flushing */
+const size_t PIPELINE_KEYS = 1 << 16;
+
+template <typename Job>
+Mapper<Job>::Mapper(int id, const Options *options, vector<string> *files, vector<MapTask> *tasks, TaskScheduler *scheduler, const Partitioner *partitioner, Shuffle *shuffle) {
     this->worker_id = id;
-    this->input_dir = input_dir;
-    this->output_dir = output_dir;
-    this->start_file = start;
-    this->end_file = end;
-    this->nreduce = nreduce;
+    this->options = options;
+    this->nreduce = options->nreduce;
     this->files = files;
-    this->partitions = vector<string>(nreduce, "");
+    this->tasks = tasks;
+    this->scheduler = scheduler;
+    this->partitioner = partitioner;
+    this->shuffle = shuffle;
+    // blocks handed over in memory never touch the disk, so they stay raw
+    this->level = shuffle ? 0 : options->compress;
+    if (options->io != IO_MMAP) {
+        this->io.reset(new IoEngine(options->io));
+    }
+    this->partitions = vector<string>(this->nreduce, "");
+    this->stats.id = id;
+    this->stats.partition_records.assign(this->nreduce, 0);
+    if (options->combine) {
+        this->combined = vector<CountTable>(this->nreduce);
+    }
+    if (options->dictionary) {
+        this->dictionaries = vector<KeyDictionary>(this->nreduce);
+        this->encoded.assign(this->nreduce, 0);
+    }
+    if (options->approx) {
+        this->sketches.reserve(this->nreduce);
+        for (int i = 0; i < this->nreduce; i++) this->sketches.emplace_back(options->top_k);
+    }
 }
 
-vector<string> Mapper::split(string line, char delimiter) {
-    vector<string> words;
-    stringstream ss(line);
-    string word;
-    while (getline(ss, word, delimiter)) {
-        words.push_back(word);
+template <typename Job>
+void Mapper<Job>::createPartitionFiles() {
+    // after a spill, the last run goes after the spilled ones
+    if (!this->spills.empty()) {
+        for (int i = 0; i < this->nreduce; i++) {
+            string block = this->encodeRun(i);
+            this->stats.bytes_written += block.size();
+            this->writeTo(*this->spills[i], block);
+        }
+        this->commitFiles(this->spills);
+        return;
     }
-    return words;
-}
 
-void Mapper::createPartitionFiles() {
+    // with an I/O engine, a partition is written while the next one is encoded
     for (int i = 0; i < this->nreduce; i++) {
-        string filename = this->output_dir + "/map.part-" + to_string(this->worker_id) + "-" + to_string(i) + ".txt";
-        ofstream output(filename);
-        output << this->partitions[i];
-        output.close();
+        this->writeBlock(i, this->encodeBlock(i));
     }
+    this->commitFiles(this->outputs);
 }
 
-int Mapper::partition(string key) {
-    size_t hash = 0;
-    for (char c : key) {
-        hash = (hash * 31) + c;
+template <typename Job>
+void Mapper<Job>::writeTo(AtomicFile &file, string_view block) {
+    if (this->io) {
+        file.append(block, this->io.get());
+    } else {
+        file.append(block);
     }
-    return int(hash % this->nreduce);
 }
 
-bool Mapper::isLatin(string &w) {
-    string new_w = "";
-    for (char c : w) {
-        if (!isalpha(c)) {
-            return false;
+template <typename Job>
+void Mapper<Job>::commitFiles(vector<unique_ptr<AtomicFile>> &files) {
+    if (this->io) this->io->drain();
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!files[i]->commit()) {
+            cerr << "Could not write partition file: " << mapPartFile(*this->options, this->worker_id, i) << endl;
         }
-        if (isupper(c)) {
-            new_w += tolower(c);
-        } else {
-            new_w += c;
+    }
+    files.clear();
+}
+
+template <typename Job>
+void Mapper<Job>::writeBlock(int part, string &&block) {
+    this->stats.bytes_written += block.size();
+    if (this->shuffle) {
+        this->shuffle->put(part, move(block));
+        return;
+    }
+
+    this->outputs.emplace_back(new AtomicFile(mapPartFile(*this->options, this->worker_id, part)));
+    this->writeTo(*this->outputs.back(), block);
+}
+
+template <typename Job>
+string Mapper<Job>::encodeBlock(int part) {
+    if (this->options->approx) return this->encodeSketch(part);
+    if (this->options->text_intermediate) return this->encodeText(part);
+    if (this->options->dictionary) return this->encodeDictionary(part);
+    return this->encodeRun(part);
+}
+
+template <typename Job>
+string Mapper<Job>::encodeSketch(int part) {
+    string block = this->sketches[part].encode();
+    this->sketches[part].clear();
+    return block;
+}
+
+template <typename Job>
+string Mapper<Job>::encodeText(int part) {
+    if (this->options->combine) {
+        this->flushCombiner(part);
+    }
+    string block = move(this->partitions[part]);
+    this->partitions[part].clear();
+    return block;
+}
+
+template <typename Job>
+string Mapper<Job>::encodeRun(int part) {
+    vector<pair<string_view, uint64_t>> records;
+    if (this->options->combine) {
+        records = this->combined[part].entries();
+    } else {
+        string_view encoded = this->partitions[part];
+        size_t pos = 0;
+        uint64_t length, value;
+        while (getVarint(encoded, pos, length)) {
+            string_view key = encoded.substr(pos, length);
+            pos += length;
+            getVarint(encoded, pos, value);
+            records.emplace_back(key, value);
         }
     }
-    w = new_w;
-    return true;
+
+    sort(records.begin(), records.end());
+
+    RunWriter writer(this->level);
+    for (auto &[key, count] : records) {
+        writer.add(key, count);
+    }
+    string block = writer.finish();
+
+    this->partitions[part].clear();
+    if (this->options->combine) {
+        this->combined[part].clear();
+    }
+    return block;
+}
+
+template <typename Job>
+string Mapper<Job>::encodeDictionary(int part) {
+    // combined keys appear once, so their ids would only add bytes
+    if (this->options->combine) return this->encodeRun(part);
+
+    string block = encodeDictionaryRun(this->dictionaries[part].keys(), this->partitions[part], this->encoded[part], this->level);
+    this->partitions[part].clear();
+    this->dictionaries[part].clear();
+    this->encoded[part] = 0;
+    return block;
 }
 
-void Mapper::symbolStrip(vector<string> &words) {
-    vector<string> strip_commas;
-    vector<string> strip_apostrophes;
+template <typename Job>
+void Mapper<Job>::flushIfFull(int part) {
+    bool full = this->options->combine ?
+        this->combined[part].size() >= PIPELINE_KEYS :
+        this->partitions[part].size() >= PIPELINE_CHUNK;
+    if (!full) return;
+
+    this->writeBlock(part, this->encodeBlock(part));
+}
 
-    /* Strip commas */
-    for (string word : words) {
-        if (word.find(',') != string::npos) {
-            vector<string> temp = this->split(word, ',');
-            for (string t : temp) strip_commas.push_back(t);
-        } else if (word.find('\'') != string::npos) {
-            strip_commas.push_back(word);
+template <typename Job>
+void Mapper<Job>::spill() {
+    if (this->spills.empty()) {
+        for (int i = 0; i < this->nreduce; i++) {
+            this->spills.emplace_back(new AtomicFile(mapPartFile(*this->options, this->worker_id, i)));
         }
     }
 
-    /* Strip apostrophes */
-    for (string word : strip_commas) {
-        if (word.find('\'') != string::npos) {
-            vector<string> temp = this->split(word, '\'');
-            for (string t : temp) strip_apostrophes.push_back(t);
-        } else {
-            strip_apostrophes.push_back(word);
+    for (int i = 0; i < this->nreduce; i++) {
+        string block = this->encodeRun(i);
+        this->stats.bytes_written += block.size();
+        this->writeTo(*this->spills[i], block);
+    }
+    // the written runs must not stay in memory past the budget
+    if (this->io) this->io->drain();
+    this->buffered = 0;
+    this->stats.spills++;
+}
+
+template <typename Job>
+void Mapper<Job>::emit(string_view key, typename Job::Value value) {
+    int part = this->partitioner->partition(key);
+    this->stats.partition_records[part]++;
+    if (this->options->approx) {
+        this->sketches[part].add(key, value);
+        return;
+    }
+
+    // what the partition holds, plus the record's entry when encodeRun sorts it
+    size_t held = this->options->combine ? this->combined[part].size() : this->partitions[part].size();
+    if (this->options->combine) {
+        this->combined[part].add(key, value, this->combine_fn);
+    } else if (this->options->text_intermediate) {
+        char digits[24];
+        this->partitions[part].append(key);
+        this->partitions[part].push_back(',');
+        this->partitions[part].append(digits, to_chars(digits, digits + sizeof(digits), value).ptr);
+        this->partitions[part].push_back('\n');
+    } else if (this->options->dictionary) {
+        putVarint(this->partitions[part], this->dictionaries[part].id(key));
+        putVarint(this->partitions[part], value);
+        this->encoded[part]++;
+    } else {
+        putVarint(this->partitions[part], key.size());
+        this->partitions[part].append(key);
+        putVarint(this->partitions[part], value);
+    }
+
+    if (this->options->memory_budget) {
+        if (!this->options->combine) {
+            this->buffered += this->partitions[part].size() - held + sizeof(pair<string_view, uint64_t>);
+        } else if (this->combined[part].size() > held) {
+            this->buffered += key.size() + 2 * sizeof(CountTable::Slot) + sizeof(pair<string_view, uint64_t>);
         }
+        if (this->buffered > this->options->memory_budget) this->spill();
+    }
+
+    if (this->options->pipeline) {
+        this->flushIfFull(part);
     }
+}
 
-    /* append new words to words */
-    for (string word : strip_apostrophes) {
-        if (word == " " ||
-            word == "" ||
-            word == "," ||
-            word == "\'"
-        ) continue;
-
-        words.push_back(word);
-    }
-}
-
-void Mapper::map() {
-    for (int i = this->start_file; i < this->end_file; i++) {
-        cout << "Mapping file: " << this->files->at(i) << endl;
-        string file = this->files->at(i);
-        ifstream input(file);
-        string line;
-        while (getline(input, line)) {
-            vector<string> words = this->split(line, ' ');
-            this->symbolStrip(words);
-            for (string word : words) {
-                if (!this->isLatin(word)) continue;
-                int part = this->partition(word);
-                this->partitions[part] += (word + ",1\n");
-            }
+template <typename Job>
+void Mapper<Job>::flushCombiner(int part) {
+    string &buffer = this->partitions[part];
+    this->combined[part].forEach([&buffer](string_view key, uint64_t count) {
+        buffer.append(key);
+        buffer.push_back(',');
+        buffer.append(to_string(count));
+        buffer.push_back('\n');
+    });
+    this->combined[part].clear();
+}
+
+template <typename Job>
+void Mapper<Job>::map() {
+    Stopwatch watch;
+    int i;
+    while (this->scheduler->next(this->worker_id, i)) {
+        this->mapSplit(i);
+    }
+    this->finish(watch);
+}
+
+template <typename Job>
+void Mapper<Job>::mapTask(int task) {
+    Stopwatch watch;
+    this->mapSplit(task);
+    this->finish(watch);
+}
+
+template <typename Job>
+void Mapper<Job>::mapSplit(int i) {
+    const MapTask &task = this->tasks->at(i);
+    const string &file = this->files->at(task.file);
+    if (this->options->incremental && task.cached && this->replaySplit(task)) return;
+
+    cout << "Worker " << this->worker_id << " mapping file: " << file;
+    if (this->options->split_size) cout << " [" << task.begin << ", " << task.end << ")";
+    cout << endl;
+
+    this->stats.tasks++;
+    if (this->options->incremental) {
+        CountTable counts;
+        this->readSplit(task, [this, &counts](string_view key, typename Job::Value value) {
+            counts.add(key, value, this->combine_fn);
+        });
+        this->cacheSplit(task, counts);
+        return;
+    }
+    this->readSplit(task, [this](string_view key, typename Job::Value value) {
+        this->emit(key, value);
+    });
+}
+
+template <typename Job>
+template <typename Emit>
+void Mapper<Job>::readSplit(const MapTask &task, Emit &&emit) {
+    const string &file = this->files->at(task.file);
+    InputFile input(file);
+    string_view split = Job::Map::align(input.data(), task.begin, task.end);
+    this->stats.bytes_read += split.size();
+    if (!this->io) {
+        this->map_fn(split, emit);
+        return;
+    }
+    if (split.empty()) return;
+
+    // the mapping only finds the split's boundaries, its bytes are streamed
+    uint64_t begin = split.data() - input.data().data();
+    if (!this->io->open(file, begin, begin + split.size())) return;
+    string carry;
+    char *data;
+    size_t length;
+    while (this->io->next(data, length)) {
+        // the partial record of the last chunk goes in front of this one
+        string_view text;
+        if (carry.size() <= IO_HEADROOM) {
+            memcpy(data - carry.size(), carry.data(), carry.size());
+            text = string_view(data - carry.size(), carry.size() + length);
+        } else {
+            carry.append(data, length);
+            text = carry;
         }
+        size_t whole = Job::Map::complete(text);
+        this->map_fn(text.substr(0, whole), emit);
+        carry = string(text.substr(whole));
     }
+    this->map_fn(string_view(carry), emit);
+}
+
+template <typename Job>
+bool Mapper<Job>::replaySplit(const MapTask &task) {
+    const string &file = this->files->at(task.file);
+    string filename = MapCache::runFile(*this->options, file, task);
+
+    // a split with no run, after --split-size changed, is an expected miss
+    if (access(filename.c_str(), F_OK) != 0) return false;
+    RunReader run(filename);
+    if (!run.valid()) return false;
+
+    cout << "Worker " << this->worker_id << " reusing cached map output: " << file;
+    if (this->options->split_size) cout << " [" << task.begin << ", " << task.end << ")";
+    cout << endl;
+
+    this->stats.tasks++;
+    this->stats.bytes_read += run.size();
+    while (run.next()) {
+        this->emit(run.key(), run.count());
+    }
+    return true;
+}
+
+template <typename Job>
+void Mapper<Job>::cacheSplit(const MapTask &task, CountTable &counts) {
+    vector<pair<string_view, uint64_t>> records = counts.entries();
+    sort(records.begin(), records.end());
+    RunWriter writer(this->options->compress);
+    for (auto &[key, count] : records) {
+        writer.add(key, count);
+    }
+    string filename = MapCache::runFile(*this->options, this->files->at(task.file), task);
+    if (!writer.write(filename)) {
+        cerr << "Could not write cached map output: " << filename << endl;
+    }
+
+    for (auto &[key, count] : records) {
+        this->emit(key, count);
+    }
+}
+
+template <typename Job>
+void Mapper<Job>::finish(const Stopwatch &watch) {
     this->createPartitionFiles();
+    if (this->shuffle) {
+        this->shuffle->close();
+    }
+
+    for (uint64_t records : this->stats.partition_records) {
+        this->stats.records_out += records;
+    }
+    this->stats.wall_ms = watch.wallMs();
+    this->stats.cpu_ms = watch.cpuMs();
 }
+
+template <typename Job>
+const WorkerStats &Mapper<Job>::getStats() const {
+    return this->stats;
+}
+
+template class Mapper<WordCount>;
+template class Mapper<Bigrams>;
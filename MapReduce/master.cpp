@@ -1,119 +1,582 @@
 #include "headers.hpp"
 
-Master::Master(string input_dir, string output_dir, int nworkers, int nreduce) {
-    this->input_dir = input_dir;
-    this->output_dir = output_dir;
-    this->nworkers = nworkers;
-    this->nreduce = nreduce;
-    this->beginMapReduce();
+/* blocks a pipelined shuffle channel holds before mappers wait */
+const size_t PIPELINE_QUEUE = 16;
+
+/* bytes of output.txt buffered between writes */
+const size_t MERGE_BUFFER = 1 << 20;
+
+/* input bytes the range partitioner samples to pick its split points */
+const uint64_t SAMPLE_BYTES = 1 << 20;
+
+/* bytes of each sampled window of the input */
+const uint64_t SAMPLE_WINDOW = 1 << 14;
+
+Master::Master(int nthreads) : pool(nthreads) {
 }
 
-void Master::mapPhase() {
-    cout << "\nMap phase started" << endl;
+bool Master::run(const Options &options) {
+    this->options = options;
+    this->files.clear();
+    this->tasks.clear();
+    this->shuffle.reset();
+    this->cache.reset();
+    this->watched.clear();
+    this->mapped.clear();
+    this->inodes.clear();
+    this->stats = JobStats();
 
-    // count number of files in input directory
-    int nFiles = this->countAndStoreFiles();
+    Stopwatch watch(CLOCK_PROCESS_CPUTIME_ID);
+    bool ok = this->beginMapReduce();
+    this->stats.wall_ms = watch.wallMs();
+    this->stats.cpu_ms = watch.cpuMs();
 
-    // create a vector of workers
-    this->workers = new std::thread[this->nworkers];
+    writeJobStats(this->stats, this->options, this->options.output_dir + "/_job_stats.json");
+    return ok;
+}
 
-    // create a mapper for each thread and allocate an equal number of files to each mapper
-    int filesPerWorker = nFiles / this->nworkers;
-    int remainingFiles = nFiles % this->nworkers;
-    int start = 0;
+void Master::mapPhase() {
+    cout << "\nMap phase started" << endl;
+    Stopwatch watch;
 
-    for (int i = 0; i < this->nworkers; i++) {
-        int end = start + filesPerWorker;
-        if (i < remainingFiles) {
-            end++;
-        }
+    // count number of files in input directory and split them into tasks
+    this->countAndStoreFiles();
+    this->createTasks();
+    this->openCache();
+    this->createPartitioner();
 
-        // start a new thread for each mapper
-        cout << "Worker " << i << " will process files " << start << " to " << end << endl;
-        Mapper* mapper = new Mapper(i, this->input_dir, this->output_dir, start, end, this->nreduce, &this->files);
-        this->workers[i] = std::thread(&Mapper::map, mapper);
+    // tasks are sorted by descending size, so big splits start first
+    vector<int> order(this->tasks.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    TaskScheduler scheduler(this->options.nworkers, order);
 
-        start = end;
+    // with the memory shuffle, partitions stay in memory until the reducers take them
+    if (this->options.shuffle == SHUFFLE_MEMORY && !this->shuffle) {
+        this->shuffle.reset(new Shuffle(this->options.nreduce, this->options.nworkers));
     }
 
-    // wait for all workers to finish
-    for (int i = 0; i < this->nworkers; i++) {
-        this->workers[i].join();
+    switch (this->options.job) {
+        case JOB_BIGRAMS: this->runMappers<Bigrams>(scheduler); break;
+        default: this->runMappers<WordCount>(scheduler); break;
     }
+    this->stats.map.wall_ms = watch.wallMs();
 
     cout << "Map phase complete\n" << endl;
 }
 
+template <typename Job>
+void Master::runMappers(TaskScheduler &scheduler) {
+    // one mapper per pool thread, the mappers pull files from the scheduler
+    vector<Mapper<Job>> mappers;
+    mappers.reserve(this->options.nworkers);
+    for (int i = 0; i < this->options.nworkers; i++) {
+        mappers.emplace_back(i, &this->options, &this->files, &this->tasks, &scheduler, &this->partitioner, this->shuffle.get());
+    }
+
+    // run returns once every mapper is done
+    this->pool.run(mappers.size(), [&mappers](int i) {
+        mappers[i].map();
+    });
+
+    for (const Mapper<Job> &mapper : mappers) {
+        this->stats.map.workers.push_back(mapper.getStats());
+    }
+}
+
 void Master::reducePhase() {
     cout << "Reduce phase started" << endl;
+    Stopwatch watch;
 
-    // create a vector of workers
-    this->workers = new std::thread[this->nreduce];
+    switch (this->options.job) {
+        case JOB_BIGRAMS: this->runReducers<Bigrams>(); break;
+        default: this->runReducers<WordCount>(); break;
+    }
+    this->stats.reduce.wall_ms = watch.wallMs();
+
+    cout << "Reduce phase complete\n" << endl;
+}
 
-    // create a reducer for each thread
-    for (int i = 0; i < this->nreduce; i++) {
-        Reducer* reducer = new Reducer(i, this->input_dir, this->output_dir, this->nworkers);
-        this->workers[i] = std::thread(&Reducer::reduce, reducer);
+template <typename Job>
+void Master::runReducers() {
+    // one reducer per pool thread
+    vector<Reducer<Job>> reducers;
+    reducers.reserve(this->options.nreduce);
+    for (int i = 0; i < this->options.nreduce; i++) {
+        reducers.emplace_back(i, &this->options, this->options.nworkers, this->shuffle.get());
     }
 
-    // wait for all workers to finish
-    for (int i = 0; i < this->nreduce; i++) {
-        this->workers[i].join();
+    // run returns once every reducer is done
+    this->pool.run(reducers.size(), [&reducers](int i) {
+        reducers[i].reduce();
+    });
+
+    for (const Reducer<Job> &reducer : reducers) {
+        this->stats.reduce.workers.push_back(reducer.getStats());
     }
+}
 
-    cout << "Reduce phase complete\n" << endl;
+void Master::pipelinePhase() {
+    cout << "\nPipelined map and reduce phase started" << endl;
+
+    // bounded channels make fast mappers wait for the reducers instead of buffering the job
+    this->shuffle.reset(new Shuffle(this->options.nreduce, this->options.nworkers, PIPELINE_QUEUE));
+
+    // the reducers aggregate chunks while the mappers are still producing them
+    this->pool.run(2, [this](int stage) {
+        if (stage == 0) this->reducePhase();
+        else this->mapPhase();
+    });
+
+    cout << "Pipelined map and reduce phase complete\n" << endl;
+}
+
+bool Master::processPhase() {
+    cout << "\nMap and reduce on worker processes started" << endl;
+
+    this->countAndStoreFiles();
+    this->createTasks();
+    this->openCache();
+    this->createPartitioner();
+
+    Coordinator coordinator(this->options, this->files, this->tasks, this->partitioner.getSplits(), &this->stats);
+    if (!coordinator.run()) {
+        cerr << "Map and reduce on worker processes failed" << endl;
+        return false;
+    }
+
+    cout << "Map and reduce on worker processes complete\n" << endl;
+    return true;
 }
 
 void Master::mergePhase() {
     cout << "Merge phase started" << endl;
+    Stopwatch watch;
+    WorkerStats merger;
 
-    map<string, int> counts;
-    for (int i = 0; i < this->nreduce; i++) {
-        string filename = this->output_dir + "/reduce.part-" + to_string(i) + ".txt";
-        ifstream input(filename);
-        string line;
-        while (getline(input, line)) {
-            string key = line.substr(0, line.find(','));
-            int value = stoi(line.substr(line.find(',') + 1));
-            counts[key] += value;
+    // every reduce.part file is already sorted and the key sets are disjoint
+    vector<unique_ptr<InputFile>> inputs;
+    vector<unique_ptr<BlockReader>> blocks;
+    vector<TextReader> parts;
+    for (int i = 0; i < this->options.nreduce; i++) {
+        string filename = reducePartFile(this->options, i);
+        merger.tasks++;
+        if (this->options.compress) {
+            // compressed parts are parsed one block of whole lines at a time
+            blocks.emplace_back(new BlockReader(filename));
+            parts.emplace_back(string_view());
+            merger.bytes_read += blocks.back()->size();
+        } else {
+            inputs.emplace_back(new InputFile(filename));
+            parts.emplace_back(inputs.back()->data());
+            merger.bytes_read += inputs.back()->data().size();
         }
     }
+    auto advance = [&parts, &blocks](int i) {
+        string_view block;
+        while (!parts[i].next()) {
+            if (blocks.empty() || !blocks[i]->next(block)) return false;
+            parts[i] = TextReader(block);
+        }
+        return true;
+    };
+
+    string filename = this->options.output_dir + "/output.txt";
+    AtomicFile output(filename);
+
+    // range partitions are ordered by key, so the sorted parts follow each other
+    if (keyOrdered(this->options)) {
+        auto copy = [&output, &merger](string_view part) {
+            output.append(part);
+            merger.bytes_written += part.size();
+            merger.records_out += count(part.begin(), part.end(), '\n');
+        };
+        for (auto &input : inputs) {
+            copy(input->data());
+        }
+        string_view block;
+        for (auto &reader : blocks) {
+            while (reader->next(block)) copy(block);
+        }
+        if (!output.commit()) {
+            cerr << "Could not write output file: " << filename << endl;
+        }
+        this->finishMerge(merger, watch);
+        return;
+    }
+
+    // heap of part indices with the record that sorts first on top
+    auto after = [&parts](int a, int b) {
+        return sortByValue({parts[b].key(), parts[b].count()}, {parts[a].key(), parts[a].count()});
+    };
+    priority_queue<int, vector<int>, decltype(after)> heap(after);
+    for (int i = 0; i < int(parts.size()); i++) {
+        if (advance(i)) heap.push(i);
+    }
+
+    string buffer;
+    char digits[24];
+    uint64_t written = 0;
+    while (!heap.empty() && (!this->options.top_k || written < this->options.top_k)) {
+        int i = heap.top();
+        heap.pop();
+        buffer.append(parts[i].key());
+        buffer.push_back(',');
+        buffer.append(digits, to_chars(digits, digits + sizeof(digits), parts[i].count()).ptr);
+        buffer.push_back('\n');
+        written++;
+        if (advance(i)) heap.push(i);
+
+        if (buffer.size() >= MERGE_BUFFER) {
+            merger.bytes_written += buffer.size();
+            output.append(buffer);
+            buffer.clear();
+        }
+    }
+    merger.bytes_written += buffer.size();
+    output.append(buffer);
+    if (!output.commit()) {
+        cerr << "Could not write output file: " << filename << endl;
+    }
+
+    merger.records_out = written;
+    this->finishMerge(merger, watch);
+}
 
-    vector<pair<string, int>> sorted(counts.begin(), counts.end());
-    sort(sorted.begin(), sorted.end(), sortByValue);
+void Master::mergeSketches() {
+    cout << "Merge phase started" << endl;
+    Stopwatch watch;
+    WorkerStats merger;
+
+    typedef struct Estimate {
+        string key;         /**< the heavy hitter */
+        uint64_t count;     /**< its Count-Min estimate */
+        uint64_t bound;     /**< how much the estimate may overcount */
+    } Estimate;
+
+    // partitions hold disjoint keys, so an estimate keeps the bound of its own partition
+    vector<Estimate> estimates;
+    HyperLogLog distinct;
+    ApproxSketch sketch(this->options.top_k);
+    for (int i = 0; i < this->options.nreduce; i++) {
+        string filename = reducePartFile(this->options, i);
+        InputFile input(filename);
+        merger.tasks++;
+        merger.bytes_read += input.data().size();
+        if (!sketch.decode(input.data(), filename)) continue;
+
+        distinct.merge(sketch.distinct());
+        merger.records_in += sketch.counts().total();
+        for (auto &[key, count] : sketch.top(this->options.top_k)) {
+            estimates.push_back(Estimate{string(key), count, sketch.counts().bound()});
+        }
+    }
 
-    string filename = this->output_dir + "/output.txt";
-    ofstream output(filename);
-    for (auto it = sorted.begin(); it != sorted.end(); it++) {
-        output << it->first << "," << it->second << "\n";
+    sort(estimates.begin(), estimates.end(), [](const Estimate &a, const Estimate &b) {
+        return sortByValue({a.key, a.count}, {b.key, b.count});
+    });
+    if (estimates.size() > this->options.top_k) estimates.resize(this->options.top_k);
+
+    // the true count of a key is between count - bound and count
+    string buffer;
+    for (const Estimate &estimate : estimates) {
+        buffer.append(estimate.key);
+        buffer.append("," + to_string(estimate.count) + "," + to_string(estimate.bound) + "\n");
+        this->stats.overcount = max(this->stats.overcount, estimate.bound);
+    }
+    string filename = this->options.output_dir + "/output.txt";
+    if (!commitFile(filename, buffer)) {
+        cerr << "Could not write output file: " << filename << endl;
     }
-    output.close();
+    merger.bytes_written = buffer.size();
+    merger.records_out = estimates.size();
+
+    this->stats.distinct_keys = distinct.estimate();
+    cout << "About " << uint64_t(this->stats.distinct_keys + 0.5) << " distinct keys (standard error "
+         << 100 * HyperLogLog::error() << "%), estimates overcount by at most " << this->stats.overcount
+         << " with probability " << CountMinSketch::confidence() << endl;
+
+    merger.wall_ms = watch.wallMs();
+    merger.cpu_ms = watch.cpuMs();
+    this->stats.merge.wall_ms = merger.wall_ms;
+    this->stats.merge.workers.push_back(merger);
+    cout << "Merge phase complete" << endl;
+}
+
+void Master::finishMerge(WorkerStats &merger, const Stopwatch &watch) {
+    merger.records_in = merger.records_out;
+    merger.wall_ms = watch.wallMs();
+    merger.cpu_ms = watch.cpuMs();
+    this->stats.merge.wall_ms = merger.wall_ms;
+    this->stats.merge.workers.push_back(merger);
 
     cout << "Merge phase complete" << endl;
 }
 
-void Master::beginMapReduce() {
-    /* Start the map phase */
-    this->mapPhase();
+bool Master::beginMapReduce() {
+    if (this->options.watch) {
+        /* Map, reduce and merge every round of new input */
+        return this->watchPhase();
+    }
+
+    if (this->options.processes) {
+        /* Run the map and reduce tasks on worker processes */
+        if (!this->processPhase()) return false;
+    } else if (this->options.pipeline) {
+        /* Run the map and reduce phases concurrently */
+        this->pipelinePhase();
+    } else {
+        /* Start the map phase */
+        this->mapPhase();
 
-    /* Start the reduce phase */
-    this->reducePhase();
+        /* Start the reduce phase */
+        this->reducePhase();
+    }
 
     /* Start the merge phase */
-    this->mergePhase();
+    if (this->options.approx) {
+        this->mergeSketches();
+    } else {
+        this->mergePhase();
+    }
+
+    /* Trust the cached map output of this job from now on */
+    this->commitCache();
+    return true;
+}
+
+bool Master::watchPhase() {
+    DirectoryWatch watch(this->options.input_dir);
+    if (!watch.valid()) return false;
+    cout << "\nWatching " << this->options.input_dir << " for new input, interrupt to stop" << endl;
+
+    switch (this->options.job) {
+        case JOB_BIGRAMS: this->watchInput<Bigrams>(watch); break;
+        default: this->watchInput<WordCount>(watch); break;
+    }
+
+    cout << "Watch stopped after " << this->stats.snapshots << " snapshots" << endl;
+    return true;
+}
+
+template <typename Job>
+void Master::watchInput(DirectoryWatch &watch) {
+    unordered_set<string> changed;
+    for (const string &path : DirectoryWatch::listFiles(this->options.input_dir)) {
+        changed.insert(path);
+    }
+    this->createDeltaTasks<Job>(changed, false);
+
+    this->createPartitioner();
+
+    // the reducers and their counts live as long as the watch
+    vector<Reducer<Job>> reducers;
+    reducers.reserve(this->options.nreduce);
+    for (int i = 0; i < this->options.nreduce; i++) {
+        reducers.emplace_back(i, &this->options, this->options.nworkers, nullptr);
+    }
+
+    bool stopping = false;
+    while (true) {
+        if (!this->tasks.empty()) {
+            Stopwatch round;
+            this->stats.rounds++;
+            this->stats.map = PhaseStats();
+            this->shuffle.reset(new Shuffle(this->options.nreduce, this->options.nworkers));
+
+            vector<int> order(this->tasks.size());
+            for (size_t i = 0; i < order.size(); i++) order[i] = i;
+            TaskScheduler scheduler(this->options.nworkers, order);
+            this->runMappers<Job>(scheduler);
+            this->stats.map.wall_ms = round.wallMs();
+
+            // the shuffle is closed, so the reducers drain it and publish right away
+            Stopwatch reduce;
+            this->pool.run(reducers.size(), [this, &reducers](int i) {
+                reducers[i].absorb(this->shuffle.get());
+                reducers[i].publish();
+            });
+            this->shuffle.reset();
+            this->stats.reduce = PhaseStats();
+            for (const Reducer<Job> &reducer : reducers) {
+                this->stats.reduce.workers.push_back(reducer.getStats());
+            }
+            this->stats.reduce.wall_ms = reduce.wallMs();
+
+            this->stats.merge = PhaseStats();
+            this->mergePhase();
+            this->stats.snapshots++;
+            writeJobStats(this->stats, this->options, this->options.output_dir + "/_job_stats.json");
+            cout << "Published snapshot " << this->stats.snapshots << " after " << round.wallMs() << " ms\n" << endl;
+        }
+        if (stopping) break;
+
+        // input that arrives before the stop still makes it into the last snapshot
+        changed.clear();
+        if (!watch.wait(this->options.watch_interval, changed)) {
+            if (!watch.stopped()) cerr << "Watching " << this->options.input_dir << " failed" << endl;
+            stopping = true;
+
+            // the partial last records held back so far are mapped as they are
+            for (auto &[path, i] : this->watched) changed.insert(path);
+        }
+        this->createDeltaTasks<Job>(changed, stopping);
+    }
+}
+
+template <typename Job>
+void Master::createDeltaTasks(const unordered_set<string> &changed, bool final) {
+    this->tasks.clear();
+    vector<string> sorted(changed.begin(), changed.end());
+    sort(sorted.begin(), sorted.end());
+
+    for (const string &path : sorted) {
+        auto it = this->watched.find(path);
+        if (it == this->watched.end()) {
+            it = this->watched.emplace(path, this->files.size()).first;
+            this->files.push_back(path);
+            this->mapped.push_back(0);
+            this->inodes.push_back(0);
+        }
+        int i = it->second;
+
+        // a file removed since its event has nothing to map
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+        uint64_t size = st.st_size;
+        if (this->mapped[i] && st.st_ino != this->inodes[i]) {
+            // a file renamed over the path, its bytes have nothing to do with the old ones
+            cerr << "Input file replaced, mapping it from the start: " << path << endl;
+            this->mapped[i] = 0;
+        } else if (size < this->mapped[i]) {
+            cerr << "Input file shrank, mapping it again from the start: " << path << endl;
+            this->mapped[i] = 0;
+        }
+        this->inodes[i] = st.st_ino;
+
+        uint64_t begin = this->mapped[i], end = size;
+        if (!final && end > begin) {
+            // even a closed file may be appended to, so the last record waits for more bytes or the stop
+            InputFile input(path);
+            string_view text = input.data().substr(0, min<uint64_t>(end, input.data().size()));
+            end = text.size() > begin ? begin + Job::Map::complete(text.substr(begin)) : begin;
+        }
+
+        uint64_t split = this->options.split_size ? this->options.split_size : max<uint64_t>(end - begin, 1);
+        for (uint64_t first = begin; first < end; first += split) {
+            this->tasks.push_back(MapTask{i, first, min(first + split, end)});
+        }
+        this->mapped[i] = max(begin, end);
+    }
+
+    stable_sort(this->tasks.begin(), this->tasks.end(), [](const MapTask &a, const MapTask &b) {
+        return a.end - a.begin > b.end - b.begin;
+    });
 }
 
 int Master::countAndStoreFiles () {
-    int count = 0;
-    for (const auto & entry : filesystem::directory_iterator(this->input_dir)) {
+    vector<pair<uintmax_t, string>> sized;
+    for (const auto & entry : filesystem::directory_iterator(this->options.input_dir)) {
         if (entry.path().extension() == ".txt") {
-            this->files.push_back(entry.path());
-            count++;
+            sized.emplace_back(entry.file_size(), entry.path());
+        }
+    }
+
+    sort(sized.begin(), sized.end(), greater<>());
+    for (auto &[size, path] : sized) {
+        this->files.push_back(path);
+    }
+    return sized.size();
+}
+
+void Master::createTasks() {
+    for (int i = 0; i < int(this->files.size()); i++) {
+        uint64_t size = filesystem::file_size(this->files[i]);
+        uint64_t split = this->options.split_size ? this->options.split_size : max<uint64_t>(size, 1);
+        for (uint64_t begin = 0; begin < size || begin == 0; begin += split) {
+            this->tasks.push_back(MapTask{i, begin, min(begin + split, size)});
+        }
+    }
+
+    stable_sort(this->tasks.begin(), this->tasks.end(), [](const MapTask &a, const MapTask &b) {
+        return a.end - a.begin > b.end - b.begin;
+    });
+    cout << "Created " << this->tasks.size() << " map tasks" << endl;
+}
+
+void Master::openCache() {
+    if (!this->options.incremental) return;
+    this->cache.reset(new MapCache(this->options));
+
+    vector<bool> fresh(this->files.size());
+    for (size_t i = 0; i < this->files.size(); i++) {
+        fresh[i] = this->cache->lookup(this->files[i]);
+        if (fresh[i]) this->stats.cached_files++;
+    }
+    for (MapTask &task : this->tasks) {
+        task.cached = fresh[task.file];
+    }
+    cout << "Reusing the map cache of " << this->stats.cached_files << " of " << this->files.size() << " files" << endl;
+
+    // the stale files' runs are about to be overwritten
+    if (this->stats.cached_files < this->files.size()) {
+        this->cache->forgetStale();
+    }
+}
+
+void Master::commitCache() {
+    if (!this->cache) return;
+
+    vector<string> runs;
+    for (const MapTask &task : this->tasks) {
+        runs.push_back(MapCache::runFile(this->options, this->files[task.file], task));
+    }
+    this->cache->commit(runs);
+}
+
+void Master::createPartitioner() {
+    vector<string> splits;
+    if (this->options.partition == PARTITION_RANGE) {
+        vector<string> samples;
+        switch (this->options.job) {
+            case JOB_BIGRAMS: samples = this->sampleKeys<Bigrams>(); break;
+            default: samples = this->sampleKeys<WordCount>(); break;
+        }
+        splits = Partitioner::chooseSplits(samples, this->options.nreduce);
+        cout << "Sampled " << samples.size() << " keys for " << this->options.nreduce << " key ranges" << endl;
+    }
+    this->partitioner = Partitioner(this->options.partition, this->options.nreduce, move(splits));
+}
+
+template <typename Job>
+vector<string> Master::sampleKeys() {
+    uint64_t total = 0;
+    for (const string &file : this->files) {
+        total += filesystem::file_size(file);
+    }
+
+    // small inputs are read whole, large ones through windows spread evenly over each file
+    vector<string> samples;
+    typename Job::Map map_fn;
+    for (const string &file : this->files) {
+        InputFile input(file);
+        string_view text = input.data();
+        uint64_t nwindows = 1, width = text.size();
+        if (total > SAMPLE_BYTES) {
+            nwindows = max<uint64_t>(1, text.size() * SAMPLE_BYTES / total / SAMPLE_WINDOW);
+            width = SAMPLE_WINDOW;
+        }
+
+        for (uint64_t w = 0; w < nwindows; w++) {
+            uint64_t begin = text.size() * w / nwindows;
+            string_view window = Job::Map::align(text, begin, min<uint64_t>(begin + width, text.size()));
+            map_fn(window, [&samples](string_view key, typename Job::Value) {
+                samples.emplace_back(key);
+            });
         }
     }
-    return count;
+    return samples;
 }
 
-bool sortByValue(const pair<string, int> &a, const pair<string, int> &b) {
+bool sortByValue(const pair<string_view, uint64_t> &a, const pair<string_view, uint64_t> &b) {
     return (a.second == b.second) ? (a.first < b.first) : (a.second > b.second);
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+#include "headers.hpp"
+
+Partitioner::Partitioner(PartitionMode mode, int nreduce, vector<string> splits) {
+    this->mode = mode;
+    this->nreduce = nreduce;
+    this->splits = move(splits);
+}
+
+const vector<string> &Partitioner::getSplits() const {
+    return this->splits;
+}
+
+vector<string> Partitioner::chooseSplits(vector<string> &samples, int nreduce) {
+    vector<string> splits;
+    if (samples.empty()) return splits;
+
+    // the key at each quantile of the sorted records starts a new partition
+    sort(samples.begin(), samples.end());
+    for (int r = 1; r < nreduce; r++) {
+        splits.push_back(samples[samples.size() * r / nreduce]);
+    }
+    return splits;
+}
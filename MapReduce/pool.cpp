@@ -0,0 +1,63 @@
+#include "headers.hpp"
+
+WorkerPool::WorkerPool(int nthreads) {
+    lock_guard<mutex> guard(this->lock);
+    for (int i = 0; i < nthreads; i++) {
+        this->idle++;
+        this->threads.emplace_back(&WorkerPool::work, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        lock_guard<mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    for (std::thread &thread : this->threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(int ntasks, const function<void(int)> &task) {
+    if (ntasks <= 0) return;
+
+    Batch batch{&task, ntasks};
+    unique_lock<mutex> guard(this->lock);
+
+    // every queued task must have an idle thread waiting for it
+    while (this->idle < this->queue.size() + ntasks) {
+        this->idle++;
+        this->threads.emplace_back(&WorkerPool::work, this);
+    }
+    for (int i = 0; i < ntasks; i++) {
+        this->queue.emplace_back(&batch, i);
+    }
+    this->wake.notify_all();
+
+    this->done.wait(guard, [&batch] { return batch.pending == 0; });
+}
+
+size_t WorkerPool::size() {
+    lock_guard<mutex> guard(this->lock);
+    return this->threads.size();
+}
+
+void WorkerPool::work() {
+    unique_lock<mutex> guard(this->lock);
+    while (true) {
+        this->wake.wait(guard, [this] { return this->stopping || !this->queue.empty(); });
+        if (this->queue.empty()) return;
+
+        auto [batch, index] = this->queue.front();
+        this->queue.pop_front();
+        this->idle--;
+
+        guard.unlock();
+        (*batch->task)(index);
+        guard.lock();
+
+        this->idle++;
+        if (--batch->pending == 0) this->done.notify_all();
+    }
+}
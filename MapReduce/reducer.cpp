@@ -1,36 +1,504 @@
 #include "headers.hpp"
 
-Reducer::Reducer(int id, string input_dir, string output_dir, int nworkers) {
+/* smallest buffer of a run streamed under a memory budget */
+const size_t STREAM_BUFFER = 1 << 16;
+
+template <typename Job>
+Reducer<Job>::Reducer(int id, const Options *options, int nmaps, Shuffle *shuffle) {
     this->worker_id = id;
-    this->input_dir = input_dir;
-    this->output_dir = output_dir;
-    this->nworkers = nworkers;
+    this->options = options;
+    this->nmaps = nmaps;
+    this->shuffle = shuffle;
+    this->stats.id = id;
     // this->reduce();
 }
 
-void Reducer::reduce() {
+template <typename Job>
+void Reducer<Job>::reduce() {
     cout << "Reducer " << this->worker_id << " started" << endl;
+    Stopwatch watch;
+
+    if (this->options->approx) {
+        this->reduceSketches();
+    } else if (this->options->memory_budget && !this->options->text_intermediate && !this->shuffle) {
+        this->reduceBounded();
+    } else {
+        if (this->options->text_intermediate) {
+            this->reduceText();
+        } else if (this->options->dictionary) {
+            this->reduceDictionary();
+        } else if (this->options->pipeline) {
+            this->reduceChunks();
+        } else {
+            this->reduceRuns();
+        }
+        this->writeOutput();
+    }
+
+    this->stats.wall_ms = watch.wallMs();
+    this->stats.cpu_ms = watch.cpuMs();
+}
+
+template <typename Job>
+void Reducer<Job>::absorb(Shuffle *shuffle) {
+    Stopwatch watch;
+    auto add = [this](string_view key, uint64_t value) {
+        this->counts.add(key, value, this->reduce_fn);
+        this->stats.records_in++;
+    };
+
+    string block;
+    while (shuffle->take(this->worker_id, block)) {
+        this->stats.tasks++;
+        this->stats.bytes_read += block.size();
+        if (this->options->text_intermediate) {
+            forEachTextRecord(block, add);
+            continue;
+        }
+        // plain, combined and dictionary runs all name their keys
+        RunReader run(move(block), "shuffle block for reducer " + to_string(this->worker_id));
+        while (run.next()) add(run.key(), run.count());
+    }
+
+    this->stats.wall_ms += watch.wallMs();
+    this->stats.cpu_ms += watch.cpuMs();
+}
+
+template <typename Job>
+void Reducer<Job>::publish() {
+    Stopwatch watch;
+    this->records.clear();
+    this->stats.keys = 0;
+    this->stats.records_out = 0;
+    this->counts.forEach([this](string_view key, uint64_t count) {
+        this->collect(key, count);
+    });
+    this->writeOutput();
+    this->records.clear();
+
+    this->stats.wall_ms += watch.wallMs();
+    this->stats.cpu_ms += watch.cpuMs();
+}
+
+template <typename Job>
+const WorkerStats &Reducer<Job>::getStats() const {
+    return this->stats;
+}
+
+template <typename Job>
+void Reducer<Job>::reduceText() {
+    auto add = [this](string_view key, uint64_t value) {
+        this->counts.add(key, value, this->reduce_fn);
+        this->stats.records_in++;
+    };
+
+    if (this->shuffle) {
+        string block;
+        while (this->shuffle->take(this->worker_id, block)) {
+            this->stats.tasks++;
+            this->stats.bytes_read += block.size();
+            forEachTextRecord(block, add);
+        }
+    } else {
+        for (int i = 0; i < this->nmaps; i++) {
+            InputFile input(mapPartFile(*this->options, i, this->worker_id));
+            this->stats.tasks++;
+            this->stats.bytes_read += input.data().size();
+            forEachTextRecord(input.data(), add);
+        }
+    }
+    this->counts.forEach([this](string_view key, uint64_t count) {
+        this->collect(key, count);
+    });
+}
+
+template <typename Job>
+void Reducer<Job>::reduceRuns() {
+    vector<RunReader> &runs = this->runs;
+    if (this->shuffle) {
+        vector<string> blocks;
+        string block;
+        while (this->shuffle->take(this->worker_id, block)) {
+            blocks.push_back(move(block));
+        }
+        runs.reserve(blocks.size());
+        for (string &b : blocks) {
+            runs.emplace_back(move(b), "shuffle block for reducer " + to_string(this->worker_id));
+        }
+    } else {
+        runs.reserve(this->nmaps);
+        for (int i = 0; i < this->nmaps; i++) {
+            runs.emplace_back(mapPartFile(*this->options, i, this->worker_id));
+        }
+    }
+    for (const RunReader &run : runs) {
+        this->stats.tasks++;
+        this->stats.bytes_read += run.size();
+    }
+
+    // min-heap of run indices ordered by their current key
+    auto greater = [&runs](int a, int b) {
+        return runs[a].key() > runs[b].key();
+    };
+    priority_queue<int, vector<int>, decltype(greater)> heap(greater);
+    for (int i = 0; i < int(runs.size()); i++) {
+        if (runs[i].next()) heap.push(i);
+    }
+
+    while (!heap.empty()) {
+        int first = heap.top();
+        heap.pop();
+        string_view key = runs[first].key();
+        uint64_t count = runs[first].count();
+        this->stats.records_in++;
+        if (runs[first].next()) heap.push(first);
+
+        while (!heap.empty() && runs[heap.top()].key() == key) {
+            int i = heap.top();
+            heap.pop();
+            this->reduce_fn(count, runs[i].count());
+            this->stats.records_in++;
+            if (runs[i].next()) heap.push(i);
+        }
+        this->collect(key, count);
+    }
+}
+
+template <typename Job>
+void Reducer<Job>::reduceChunks() {
+    string block;
+    while (this->shuffle->take(this->worker_id, block)) {
+        RunReader run(move(block), "pipelined chunk for reducer " + to_string(this->worker_id));
+        this->stats.tasks++;
+        this->stats.bytes_read += run.size();
+        while (run.next()) {
+            this->counts.add(run.key(), run.count(), this->reduce_fn);
+            this->stats.records_in++;
+        }
+    }
+    this->counts.forEach([this](string_view key, uint64_t count) {
+        this->collect(key, count);
+    });
+}
+
+template <typename Job>
+void Reducer<Job>::reduceDictionary() {
+    vector<uint64_t> totals;
+    vector<bool> seen;
+    vector<uint64_t> global;
+    auto add = [&](RunReader &run) {
+        this->stats.tasks++;
+        this->stats.bytes_read += run.size();
+
+        // strings are only hashed once per run, records are merged on ids
+        global.clear();
+        for (string_view key : run.keys()) {
+            global.push_back(this->dictionary.id(key));
+        }
+        totals.resize(this->dictionary.size());
+        seen.resize(this->dictionary.size());
+        while (run.next()) {
+            // combined runs are plain runs, their keys are looked up per record
+            uint64_t id = run.dictionary() ? global[run.id()] : this->dictionary.id(run.key());
+            if (id >= totals.size()) {
+                totals.resize(id + 1);
+                seen.resize(id + 1);
+            }
+            if (seen[id]) {
+                this->reduce_fn(totals[id], run.count());
+            } else {
+                totals[id] = run.count();
+                seen[id] = true;
+            }
+            this->stats.records_in++;
+        }
+    };
+
+    if (this->shuffle) {
+        string block;
+        while (this->shuffle->take(this->worker_id, block)) {
+            RunReader run(move(block), "shuffle block for reducer " + to_string(this->worker_id));
+            add(run);
+        }
+    } else {
+        for (int i = 0; i < this->nmaps; i++) {
+            RunReader run(mapPartFile(*this->options, i, this->worker_id));
+            add(run);
+        }
+    }
+
+    vector<string_view> keys = this->dictionary.keys();
+    for (uint64_t id = 0; id < keys.size(); id++) {
+        this->collect(keys[id], totals[id]);
+    }
+}
+
+template <typename Job>
+void Reducer<Job>::reduceSketches() {
+    ApproxSketch merged(this->options->top_k), sketch(this->options->top_k);
+    auto add = [&](string_view bytes, const string &name) {
+        this->stats.tasks++;
+        this->stats.bytes_read += bytes.size();
+        if (!sketch.decode(bytes, name)) return;
+        this->stats.records_in += sketch.counts().total();
+        merged.merge(sketch);
+    };
+
+    if (this->shuffle) {
+        string block;
+        while (this->shuffle->take(this->worker_id, block)) {
+            add(block, "shuffle block for reducer " + to_string(this->worker_id));
+        }
+    } else {
+        for (int i = 0; i < this->nmaps; i++) {
+            string filename = mapPartFile(*this->options, i, this->worker_id);
+            InputFile input(filename);
+            add(input.data(), filename);
+        }
+    }
 
-    vector<string> files;
-    for (int i = 0; i < this->nworkers; i++) {
-        string filename = this->output_dir + "map.part-" + to_string(i) + "-" + to_string(this->worker_id) + ".txt";
-        files.push_back(filename);
+    string filename = reducePartFile(*this->options, this->worker_id);
+    string block = merged.encode();
+    if (!commitFile(filename, block)) {
+        cerr << "Could not write output file: " << filename << endl;
+    }
+    this->stats.bytes_written = block.size();
+    this->stats.keys = uint64_t(merged.distinct().estimate() + 0.5);
+}
+
+template <typename Job>
+void Reducer<Job>::reduceBounded() {
+    vector<RunSource> sources;
+    for (int i = 0; i < this->nmaps; i++) {
+        string file = mapPartFile(*this->options, i, this->worker_id);
+        for (uint64_t offset : runOffsets(file)) {
+            sources.push_back(RunSource{file, offset});
+        }
     }
 
-    map<string, int> counts;
-    for (string file : files) {
-        ifstream input(file);
-        string line;
-        while (getline(input, line)) {
-            string key = line.substr(0, line.find(','));
-            counts[key] += 1;
+    string filename = reducePartFile(*this->options, this->worker_id);
+    this->output.reset(new AtomicFile(filename));
+    auto byKey = [](const pair<string_view, uint64_t> &a, const pair<string_view, uint64_t> &b) {
+        return a.first < b.first;
+    };
+    this->mergeRuns(sources, byKey, true, [this](string_view key, uint64_t count) {
+        this->keep(key, count);
+    });
+
+    if (keyOrdered(*this->options)) {
+        // keep already wrote every record in order
+    } else if (this->options->top_k || this->sorted.empty()) {
+        sort(this->records.begin(), this->records.end(), sortByValue);
+        for (auto &[key, count] : this->records) {
+            this->writeLine(key, count);
         }
+    } else {
+        // the output was spilled in sorted runs, which are merged into the file
+        this->spillRecords();
+        this->mergeRuns(this->sorted, sortByValue, false, [this](string_view key, uint64_t count) {
+            this->writeLine(key, count);
+        });
     }
 
-    string filename = this->output_dir + "/reduce.part-" + to_string(this->worker_id) + ".txt";
-    ofstream output(filename);
-    for (auto it = counts.begin(); it != counts.end(); it++) {
-        output << it->first << "," << it->second << "\n";
+    this->flushText();
+    if (!this->output->commit()) {
+        cerr << "Could not write output file: " << filename << endl;
     }
-    output.close();
-}
\ No newline at end of file
+    this->stats.bytes_written = this->output->size();
+    this->output.reset();
+    this->scratch.clear();
+    this->sorted.clear();
+    this->records.clear();
+    this->arena.clear();
+}
+
+template <typename Job>
+template <typename Less, typename Emit>
+void Reducer<Job>::mergeRuns(vector<RunSource> sources, Less less, bool combine, Emit &&emit) {
+    // half of the budget buffers the runs, the other half the output records
+    size_t fanin = max<size_t>(2, this->options->memory_budget / 2 / STREAM_BUFFER);
+    while (sources.size() > fanin) {
+        vector<RunSource> merged;
+        for (size_t first = 0; first < sources.size(); first += fanin) {
+            vector<RunSource> group(sources.begin() + first, sources.begin() + min(first + fanin, sources.size()));
+            if (group.size() == 1) {
+                merged.push_back(group[0]);
+                continue;
+            }
+
+            this->scratch.emplace_back(new AtomicFile(this->options->output_dir + "/reduce.merge-" + to_string(this->worker_id) + ".bin"));
+            AtomicFile &file = *this->scratch.back();
+            RunWriter writer(this->options->compress);
+            writer.begin(&file);
+            this->mergePass(group, less, combine, [&writer](string_view key, uint64_t count) {
+                writer.add(key, count);
+            });
+            writer.end();
+            this->stats.spills++;
+            merged.push_back(RunSource{file.path(), 0});
+        }
+        sources = move(merged);
+    }
+    this->mergePass(sources, less, combine, emit);
+}
+
+template <typename Job>
+template <typename Less, typename Emit>
+void Reducer<Job>::mergePass(const vector<RunSource> &sources, Less less, bool combine, Emit &&emit) {
+    size_t capacity = max<size_t>(STREAM_BUFFER, this->options->memory_budget / 2 / max<size_t>(1, sources.size()));
+    vector<RunStream> streams;
+    streams.reserve(sources.size());
+    for (const RunSource &source : sources) {
+        streams.emplace_back(source.file, source.offset, capacity);
+        this->stats.tasks++;
+        this->stats.bytes_read += streams.back().size();
+    }
+
+    // min-heap of stream indices ordered by their current record
+    auto after = [&streams, &less](int a, int b) {
+        return less({streams[b].key(), streams[b].count()}, {streams[a].key(), streams[a].count()});
+    };
+    priority_queue<int, vector<int>, decltype(after)> heap(after);
+    for (int i = 0; i < int(streams.size()); i++) {
+        if (streams[i].next()) heap.push(i);
+    }
+
+    // the key of a stream only lives until it advances, so combined keys are copied
+    string key;
+    while (!heap.empty()) {
+        int first = heap.top();
+        heap.pop();
+        this->stats.records_in++;
+        if (!combine) {
+            emit(streams[first].key(), streams[first].count());
+            if (streams[first].next()) heap.push(first);
+            continue;
+        }
+
+        key.assign(streams[first].key());
+        uint64_t count = streams[first].count();
+        if (streams[first].next()) heap.push(first);
+        while (!heap.empty() && streams[heap.top()].key() == key) {
+            int i = heap.top();
+            heap.pop();
+            this->reduce_fn(count, streams[i].count());
+            this->stats.records_in++;
+            if (streams[i].next()) heap.push(i);
+        }
+        emit(key, count);
+    }
+}
+
+template <typename Job>
+void Reducer<Job>::keep(string_view key, uint64_t count) {
+    if (keyOrdered(*this->options)) {
+        this->stats.keys++;
+        this->writeLine(key, count);
+        return;
+    }
+
+    string_view stored(this->arena.store(key), key.size());
+    this->buffered += key.size() + sizeof(pair<string_view, uint64_t>);
+    if (this->options->top_k) {
+        this->collect(stored, count);
+        if (this->buffered <= this->options->memory_budget / 2) return;
+
+        // evicted keys stay in the arena, so the kept ones move to a new one
+        Arena kept;
+        this->buffered = 0;
+        for (auto &record : this->records) {
+            record.first = string_view(kept.store(record.first), record.first.size());
+            this->buffered += record.first.size() + sizeof(pair<string_view, uint64_t>);
+        }
+        this->arena = move(kept);
+        return;
+    }
+
+    this->stats.keys++;
+    this->records.emplace_back(stored, count);
+    if (this->buffered > this->options->memory_budget / 2) this->spillRecords();
+}
+
+template <typename Job>
+void Reducer<Job>::spillRecords() {
+    sort(this->records.begin(), this->records.end(), sortByValue);
+    this->scratch.emplace_back(new AtomicFile(this->options->output_dir + "/reduce.sort-" + to_string(this->worker_id) + ".bin"));
+    AtomicFile &file = *this->scratch.back();
+    RunWriter writer(this->options->compress);
+    writer.begin(&file);
+    for (auto &[key, count] : this->records) {
+        writer.add(key, count);
+    }
+    writer.end();
+    this->stats.spills++;
+    this->sorted.push_back(RunSource{file.path(), 0});
+
+    this->records.clear();
+    this->arena.clear();
+    this->buffered = 0;
+}
+
+template <typename Job>
+void Reducer<Job>::writeLine(string_view key, uint64_t count) {
+    char digits[24];
+    this->text.append(key);
+    this->text.push_back(',');
+    this->text.append(digits, to_chars(digits, digits + sizeof(digits), count).ptr);
+    this->text.push_back('\n');
+    this->stats.records_out++;
+    if (this->text.size() >= STREAM_BUFFER) this->flushText();
+}
+
+template <typename Job>
+void Reducer<Job>::flushText() {
+    if (this->options->compress) {
+        // blocks hold whole lines, so every block parses on its own
+        string block;
+        appendBlock(block, this->text, this->options->compress);
+        this->output->append(block);
+    } else {
+        this->output->append(this->text);
+    }
+    this->text.clear();
+}
+
+template <typename Job>
+void Reducer<Job>::collect(string_view key, uint64_t count) {
+    this->stats.keys++;
+    this->records.emplace_back(key, count);
+    if (!this->options->top_k) return;
+
+    // records is a heap with the entry that sorts last on top
+    size_t k = this->options->top_k;
+    push_heap(this->records.begin(), this->records.end(), sortByValue);
+    if (this->records.size() > k) {
+        pop_heap(this->records.begin(), this->records.end(), sortByValue);
+        this->records.pop_back();
+    }
+}
+
+template <typename Job>
+void Reducer<Job>::writeOutput() {
+    // reducers own disjoint keys, so sorting here lets the master merge by streaming
+    if (keyOrdered(*this->options)) {
+        sort(this->records.begin(), this->records.end());
+    } else {
+        sort(this->records.begin(), this->records.end(), sortByValue);
+    }
+
+    string filename = reducePartFile(*this->options, this->worker_id);
+    this->output.reset(new AtomicFile(filename));
+    for (auto &[key, count] : this->records) {
+        this->writeLine(key, count);
+    }
+
+    this->flushText();
+    if (!this->output->commit()) {
+        cerr << "Could not write output file: " << filename << endl;
+    }
+    this->stats.bytes_written = this->output->size();
+    this->output.reset();
+}
+
+template class Reducer<WordCount>;
+template class Reducer<Bigrams>;
@@ -0,0 +1,182 @@
+#include "headers.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* largest message a peer may announce */
+const uint32_t MAX_MESSAGE = 1 << 30;
+
+Message::Message(MessageType type) {
+    this->buffer.push_back(char(type));
+}
+
+Message::Message(string &&bytes) {
+    this->buffer = move(bytes);
+}
+
+MessageType Message::type() const {
+    return this->buffer.empty() ? MSG_HEARTBEAT : MessageType(uint8_t(this->buffer[0]));
+}
+
+const string &Message::bytes() const {
+    return this->buffer;
+}
+
+Message &Message::put(uint64_t value) {
+    putVarint(this->buffer, value);
+    return *this;
+}
+
+Message &Message::put(string_view value) {
+    putVarint(this->buffer, value.size());
+    this->buffer.append(value);
+    return *this;
+}
+
+bool Message::get(uint64_t &value) {
+    return getVarint(this->buffer, this->pos, value);
+}
+
+bool Message::get(string &value) {
+    uint64_t length;
+    if (!getVarint(this->buffer, this->pos, length) || length > this->buffer.size() - this->pos) return false;
+    value.assign(this->buffer, this->pos, length);
+    this->pos += length;
+    return true;
+}
+
+void putStats(Message &message, const WorkerStats &stats) {
+    message.put(uint64_t(stats.wall_ms * 1e3)).put(uint64_t(stats.cpu_ms * 1e3));
+    message.put(stats.tasks).put(stats.bytes_read).put(stats.bytes_written);
+    message.put(stats.records_in).put(stats.records_out).put(stats.keys).put(stats.spills);
+    message.put(stats.partition_records.size());
+    for (uint64_t records : stats.partition_records) {
+        message.put(records);
+    }
+}
+
+bool getStats(Message &message, WorkerStats &stats) {
+    uint64_t wall_us, cpu_us, n;
+    bool ok = message.get(wall_us) && message.get(cpu_us) &&
+        message.get(stats.tasks) && message.get(stats.bytes_read) && message.get(stats.bytes_written) &&
+        message.get(stats.records_in) && message.get(stats.records_out) && message.get(stats.keys) &&
+        message.get(stats.spills) && message.get(n);
+    if (!ok) return false;
+
+    stats.wall_ms = wall_us / 1e3;
+    stats.cpu_ms = cpu_us / 1e3;
+    stats.partition_records.assign(n, 0);
+    for (uint64_t &records : stats.partition_records) {
+        if (!message.get(records)) return false;
+    }
+    return true;
+}
+
+static bool socketAddress(const string &path, sockaddr_un &address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path too long: " << path << endl;
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+int listenUnix(const string &path) {
+    sockaddr_un address;
+    if (!socketAddress(path, address)) return -1;
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr *) &address, sizeof(address)) < 0 || listen(fd, 64) < 0) {
+        cerr << "Could not listen on " << path << ": " << strerror(errno) << endl;
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+Connection::Connection(int fd) {
+    this->socket = fd;
+}
+
+Connection::~Connection() {
+    this->close();
+}
+
+bool Connection::connectTo(const string &path) {
+    sockaddr_un address;
+    if (!socketAddress(path, address)) return false;
+
+    this->close();
+    this->socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->socket < 0) return false;
+    if (connect(this->socket, (sockaddr *) &address, sizeof(address)) < 0) {
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+int Connection::fd() const {
+    return this->socket;
+}
+
+void Connection::close() {
+    if (this->socket >= 0) {
+        ::close(this->socket);
+        this->socket = -1;
+    }
+    this->pending.clear();
+}
+
+bool Connection::send(const Message &message) {
+    if (this->socket < 0) return false;
+
+    const string &bytes = message.bytes();
+    uint32_t length = bytes.size();
+    string frame(reinterpret_cast<const char *>(&length), sizeof(length));
+    frame.append(bytes);
+
+    // MSG_NOSIGNAL turns a dead peer into an error instead of a SIGPIPE
+    size_t done = 0;
+    while (done < frame.size()) {
+        ssize_t n = ::send(this->socket, frame.data() + done, frame.size() - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+ssize_t Connection::fill() {
+    if (this->socket < 0) return -1;
+
+    char chunk[1 << 16];
+    ssize_t n;
+    do {
+        n = read(this->socket, chunk, sizeof(chunk));
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) this->pending.append(chunk, n);
+    return n;
+}
+
+bool Connection::pop(Message &message) {
+    uint32_t length;
+    if (this->pending.size() < sizeof(length)) return false;
+    memcpy(&length, this->pending.data(), sizeof(length));
+    if (length > MAX_MESSAGE || this->pending.size() - sizeof(length) < length) return false;
+
+    message = Message(this->pending.substr(sizeof(length), length));
+    this->pending.erase(0, sizeof(length) + length);
+    return true;
+}
+
+bool Connection::receive(Message &message) {
+    while (!this->pop(message)) {
+        if (this->fill() <= 0) return false;
+    }
+    return true;
+}
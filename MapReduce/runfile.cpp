@@ -0,0 +1,457 @@
+#include "headers.hpp"
+
+/* payload bytes a streamed run buffers before writing them */
+const size_t RUN_STREAM_CHUNK = 1 << 16;
+
+uint64_t runChecksum(string_view bytes, uint64_t hash) {
+    for (unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+AtomicFile::AtomicFile(const string &filename) : filename(filename) {
+    static atomic<uint64_t> sequence(0);
+    this->temporary = filename + ".tmp." + to_string(getpid()) + "." + to_string(sequence++);
+    this->fd = open(this->temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    this->ok = this->fd >= 0;
+}
+
+AtomicFile::~AtomicFile() {
+    if (this->fd >= 0) close(this->fd);
+    if (!this->committed) unlink(this->temporary.c_str());
+}
+
+bool AtomicFile::append(string_view bytes) {
+    if (this->writeAt(this->written, bytes)) this->written += bytes.size();
+    return this->ok;
+}
+
+bool AtomicFile::append(string_view bytes, IoEngine *engine) {
+    uint64_t offset = this->written;
+    this->written += bytes.size();
+    if (this->ok) engine->write(this->fd, offset, bytes, &this->ok);
+    return this->ok;
+}
+
+bool AtomicFile::writeAt(uint64_t offset, string_view bytes) {
+    size_t done = 0;
+    while (this->ok && done < bytes.size()) {
+        ssize_t n = pwrite(this->fd, bytes.data() + done, bytes.size() - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) this->ok = false;
+        else done += n;
+    }
+    return this->ok;
+}
+
+bool AtomicFile::commit() {
+    if (this->fd >= 0 && close(this->fd) != 0) this->ok = false;
+    this->fd = -1;
+    if (!this->ok || rename(this->temporary.c_str(), this->filename.c_str()) != 0) return false;
+    this->committed = true;
+    return true;
+}
+
+uint64_t AtomicFile::size() const {
+    return this->written;
+}
+
+const string &AtomicFile::path() const {
+    return this->committed ? this->filename : this->temporary;
+}
+
+bool commitFile(const string &filename, string_view bytes) {
+    AtomicFile file(filename);
+    return file.append(bytes) && file.commit();
+}
+
+void RunWriter::add(string_view key, uint64_t count) {
+    putVarint(this->payload, key.size());
+    this->payload.append(key);
+    putVarint(this->payload, count);
+    this->records++;
+    if (this->file && this->payload.size() >= RUN_STREAM_CHUNK) this->flush();
+}
+
+void RunWriter::begin(AtomicFile *file) {
+    // the header is written last, once the payload is known
+    this->file = file;
+    this->start = file->size();
+    this->flushed = 0;
+    this->checksum = RUN_CHECKSUM_SEED;
+    RunHeader header = {};
+    file->append(string_view((const char *) &header, sizeof(header)));
+}
+
+void RunWriter::flush() {
+    if (this->payload.empty()) return;
+    if (this->level) {
+        // each chunk is one block, so the stream can be decoded a block at a time
+        string block;
+        appendBlock(block, this->payload, this->level);
+        this->payload = move(block);
+    }
+    this->checksum = runChecksum(this->payload, this->checksum);
+    this->flushed += this->payload.size();
+    this->file->append(this->payload);
+    this->payload.clear();
+}
+
+bool RunWriter::end() {
+    this->flush();
+
+    RunHeader header;
+    memcpy(header.magic, RUN_MAGIC, sizeof(header.magic));
+    header.version = RUN_VERSION;
+    header.flags = this->level ? RUN_COMPRESSED : 0;
+    header.records = this->records;
+    header.payload = this->flushed;
+    header.checksum = this->checksum;
+    bool ok = this->file->writeAt(this->start, string_view((const char *) &header, sizeof(header)));
+
+    this->file = nullptr;
+    this->records = 0;
+    return ok;
+}
+
+string RunWriter::finish() {
+    if (this->level) {
+        this->payload = compressBlocks(this->payload, this->level);
+    }
+
+    RunHeader header;
+    memcpy(header.magic, RUN_MAGIC, sizeof(header.magic));
+    header.version = RUN_VERSION;
+    header.flags = this->level ? RUN_COMPRESSED : 0;
+    header.records = this->records;
+    header.payload = this->payload.size();
+    header.checksum = runChecksum(this->payload);
+
+    string bytes((const char *) &header, sizeof(header));
+    bytes.append(this->payload);
+    string().swap(this->payload);
+    this->records = 0;
+    return bytes;
+}
+
+string encodeDictionaryRun(const vector<string_view> &keys, string_view records, uint64_t nrecords, int level) {
+    string payload;
+    putVarint(payload, keys.size());
+    for (string_view key : keys) {
+        putVarint(payload, key.size());
+        payload.append(key);
+    }
+    payload.append(records);
+    if (level) {
+        payload = compressBlocks(payload, level);
+    }
+
+    RunHeader header;
+    memcpy(header.magic, RUN_MAGIC, sizeof(header.magic));
+    header.version = RUN_VERSION;
+    header.flags = RUN_DICTIONARY | (level ? RUN_COMPRESSED : 0);
+    header.records = nrecords;
+    header.payload = payload.size();
+    header.checksum = runChecksum(payload);
+
+    string bytes((const char *) &header, sizeof(header));
+    bytes.append(payload);
+    return bytes;
+}
+
+bool RunWriter::write(const string &filename) {
+    return commitFile(filename, this->finish());
+}
+
+RunReader::RunReader(const string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Could not open run file: " << filename << endl;
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(RunHeader)) {
+        this->buffer.resize(st.st_size);
+        size_t done = 0;
+        while (done < this->buffer.size()) {
+            ssize_t n = read(fd, this->buffer.data() + done, this->buffer.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
+        }
+        this->buffer.resize(done);
+    }
+    close(fd);
+
+    this->validate(filename);
+}
+
+RunReader::RunReader(string &&bytes, const string &name) {
+    this->buffer = move(bytes);
+    this->validate(name);
+}
+
+void RunReader::validate(const string &name) {
+    if (this->buffer.size() < sizeof(RunHeader)) {
+        cerr << "Truncated run file: " << name << endl;
+        return;
+    }
+
+    RunHeader header;
+    memcpy(&header, this->buffer.data(), sizeof(header));
+    string_view payload = string_view(this->buffer).substr(sizeof(header));
+    if (memcmp(header.magic, RUN_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != RUN_VERSION ||
+        header.payload != payload.size() ||
+        header.checksum != runChecksum(payload)
+    ) {
+        cerr << "Corrupt run file: " << name << endl;
+        return;
+    }
+
+    this->stored = this->buffer.size();
+    if (header.flags & RUN_COMPRESSED) {
+        string decoded(this->buffer.data(), sizeof(header));
+        if (!decompressBlocks(payload, decoded)) {
+            cerr << "Corrupt run file: " << name << endl;
+            return;
+        }
+        this->buffer = move(decoded);
+    }
+
+    this->pos = sizeof(header);
+    this->encoded = header.flags & RUN_DICTIONARY;
+    if (this->encoded) {
+        // the dictionary comes first, the records follow it
+        uint64_t nkeys, length;
+        if (!getVarint(this->buffer, this->pos, nkeys) || nkeys > this->buffer.size()) {
+            cerr << "Corrupt run file: " << name << endl;
+            return;
+        }
+        this->dictionary_keys.resize(nkeys);
+        for (string_view &key : this->dictionary_keys) {
+            if (!getVarint(this->buffer, this->pos, length) || length > this->buffer.size() - this->pos) {
+                cerr << "Corrupt run file: " << name << endl;
+                return;
+            }
+            key = string_view(this->buffer.data() + this->pos, length);
+            this->pos += length;
+        }
+    }
+    this->ok = true;
+}
+
+bool RunReader::valid() const {
+    return this->ok;
+}
+
+bool RunReader::next() {
+    uint64_t length;
+    if (!this->ok || !getVarint(this->buffer, this->pos, length)) return false;
+    if (this->encoded) {
+        if (length >= this->dictionary_keys.size()) return false;
+        this->current_id = length;
+        this->current_key = this->dictionary_keys[length];
+        return getVarint(this->buffer, this->pos, this->current_count);
+    }
+    if (length > this->buffer.size() - this->pos) return false;
+
+    this->current_key = string_view(this->buffer.data() + this->pos, length);
+    this->pos += length;
+    return getVarint(this->buffer, this->pos, this->current_count);
+}
+
+string_view RunReader::key() const {
+    return this->current_key;
+}
+
+uint64_t RunReader::count() const {
+    return this->current_count;
+}
+
+size_t RunReader::size() const {
+    return this->stored;
+}
+
+bool RunReader::dictionary() const {
+    return this->encoded;
+}
+
+const vector<string_view> &RunReader::keys() const {
+    return this->dictionary_keys;
+}
+
+uint64_t RunReader::id() const {
+    return this->current_id;
+}
+
+RunStream::RunStream(const string &filename, uint64_t offset, size_t capacity) : name(filename) {
+    this->capacity = max<size_t>(capacity, 1 << 12);
+    this->fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (this->fd < 0) {
+        cerr << "Could not open run file: " << filename << endl;
+        return;
+    }
+
+    RunHeader header;
+    if (pread(this->fd, &header, sizeof(header), offset) != sizeof(header) ||
+        memcmp(header.magic, RUN_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != RUN_VERSION
+    ) {
+        cerr << "Corrupt run file: " << filename << endl;
+        return;
+    }
+    this->offset = offset + sizeof(header);
+    this->remaining = this->payload = header.payload;
+    this->expected = header.checksum;
+    this->compressed = header.flags & RUN_COMPRESSED;
+    this->ok = true;
+}
+
+RunStream::RunStream(RunStream &&other)
+    : name(move(other.name)), stored(move(other.stored)), buffer(move(other.buffer)), current_key(other.current_key) {
+    this->fd = other.fd;
+    this->offset = other.offset;
+    this->remaining = other.remaining;
+    this->payload = other.payload;
+    this->compressed = other.compressed;
+    this->expected = other.expected;
+    this->checksum = other.checksum;
+    this->pos = other.pos;
+    this->capacity = other.capacity;
+    this->ok = other.ok;
+    this->current_count = other.current_count;
+    other.fd = -1;
+    other.ok = false;
+}
+
+RunStream::~RunStream() {
+    if (this->fd >= 0) close(this->fd);
+}
+
+bool RunStream::valid() const {
+    return this->ok;
+}
+
+bool RunStream::next() {
+    while (this->ok) {
+        string_view view(this->buffer);
+        size_t p = this->pos;
+        uint64_t length, count;
+        if (getVarint(view, p, length) && length <= view.size() - p) {
+            size_t q = p + length;
+            if (getVarint(view, q, count)) {
+                this->current_key = view.substr(p, length);
+                this->current_count = count;
+                this->pos = q;
+                return true;
+            }
+        }
+
+        // the next record is cut by the end of the buffer, or this is the end of the run
+        size_t unread = view.size() - this->pos;
+        if (this->remaining == 0) {
+            if (unread != 0 || this->checksum != this->expected) {
+                cerr << "Corrupt run file: " << this->name << endl;
+                this->ok = false;
+            }
+            return false;
+        }
+        this->refill(unread + this->capacity);
+    }
+    return false;
+}
+
+bool RunStream::refill(size_t need) {
+    this->buffer.erase(0, this->pos);
+    this->pos = 0;
+    while (this->buffer.size() < need && this->remaining > 0) {
+        if (this->compressed) {
+            if (!this->inflate()) return false;
+            continue;
+        }
+
+        size_t old = this->buffer.size();
+        size_t want = min<uint64_t>(need - old, this->remaining);
+        this->buffer.resize(old + want);
+        ssize_t n = pread(this->fd, this->buffer.data() + old, want, this->offset);
+        if (n < 0 && errno == EINTR) n = 0;
+        else if (n <= 0) {
+            cerr << "Truncated run file: " << this->name << endl;
+            this->buffer.resize(old);
+            this->ok = false;
+            return false;
+        }
+        this->buffer.resize(old + n);
+        this->checksum = runChecksum(string_view(this->buffer.data() + old, n), this->checksum);
+        this->offset += n;
+        this->remaining -= n;
+    }
+    return true;
+}
+
+bool RunStream::inflate() {
+    BlockHeader header;
+    if (this->remaining < sizeof(header) ||
+        pread(this->fd, &header, sizeof(header), this->offset) != sizeof(header) ||
+        header.stored > this->remaining - sizeof(header)
+    ) {
+        cerr << "Corrupt run file: " << this->name << endl;
+        this->ok = false;
+        return false;
+    }
+
+    this->stored.resize(header.stored);
+    if (pread(this->fd, this->stored.data(), header.stored, this->offset + sizeof(header)) != ssize_t(header.stored) ||
+        !decodeBlock(header, this->stored, this->buffer)
+    ) {
+        cerr << "Corrupt run file: " << this->name << endl;
+        this->ok = false;
+        return false;
+    }
+    this->checksum = runChecksum(string_view((const char *) &header, sizeof(header)), this->checksum);
+    this->checksum = runChecksum(this->stored, this->checksum);
+    this->offset += sizeof(header) + header.stored;
+    this->remaining -= sizeof(header) + header.stored;
+    return true;
+}
+
+string_view RunStream::key() const {
+    return this->current_key;
+}
+
+uint64_t RunStream::count() const {
+    return this->current_count;
+}
+
+uint64_t RunStream::size() const {
+    return sizeof(RunHeader) + this->payload;
+}
+
+vector<uint64_t> runOffsets(const string &filename) {
+    vector<uint64_t> offsets;
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        cerr << "Could not open run file: " << filename << endl;
+        return offsets;
+    }
+
+    struct stat st;
+    uint64_t offset = 0, size = fstat(fd, &st) == 0 ? st.st_size : 0;
+    RunHeader header;
+    while (offset + sizeof(header) <= size &&
+        pread(fd, &header, sizeof(header), offset) == sizeof(header) &&
+        memcmp(header.magic, RUN_MAGIC, sizeof(header.magic)) == 0
+    ) {
+        offsets.push_back(offset);
+        offset += sizeof(header) + header.payload;
+    }
+    if (offset != size) {
+        cerr << "Corrupt run file: " << filename << endl;
+    }
+    close(fd);
+    return offsets;
+}
@@ -0,0 +1,37 @@
+#include "headers.hpp"
+
+TaskScheduler::TaskScheduler(int nworkers, const vector<int> &tasks) {
+    for (int i = 0; i < nworkers; i++) {
+        this->queues.emplace_back(new WorkQueue());
+    }
+    for (size_t i = 0; i < tasks.size(); i++) {
+        this->queues[i % nworkers]->tasks.push_back(tasks[i]);
+    }
+}
+
+bool TaskScheduler::next(int worker, int &task) {
+    WorkQueue &own = *this->queues[worker];
+    {
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    return this->steal(worker, task);
+}
+
+bool TaskScheduler::steal(int worker, int &task) {
+    int n = this->queues.size();
+    for (int k = 1; k < n; k++) {
+        WorkQueue &victim = *this->queues[(worker + k) % n];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,44 @@
+#include "headers.hpp"
+
+Shuffle::Shuffle(int nreduce, int nproducers, size_t capacity) : producers(nproducers) {
+    this->capacity = capacity;
+    for (int i = 0; i < nreduce; i++) {
+        this->channels.emplace_back(new Channel());
+    }
+}
+
+void Shuffle::put(int part, string &&block) {
+    Channel &channel = *this->channels[part];
+    {
+        unique_lock<mutex> guard(channel.lock);
+        channel.space.wait(guard, [this, &channel] {
+            return this->capacity == 0 || channel.blocks.size() < this->capacity;
+        });
+        channel.blocks.push_back(move(block));
+    }
+    channel.ready.notify_one();
+}
+
+void Shuffle::close() {
+    this->producers--;
+
+    // take the lock so a reducer cannot miss the wakeup between its check and its wait
+    for (auto &channel : this->channels) {
+        lock_guard<mutex> guard(channel->lock);
+        channel->ready.notify_all();
+    }
+}
+
+bool Shuffle::take(int part, string &block) {
+    Channel &channel = *this->channels[part];
+    unique_lock<mutex> guard(channel.lock);
+    channel.ready.wait(guard, [this, &channel] {
+        return !channel.blocks.empty() || this->producers == 0;
+    });
+    if (channel.blocks.empty()) return false;
+
+    block = move(channel.blocks.front());
+    channel.blocks.pop_front();
+    channel.space.notify_one();
+    return true;
+}
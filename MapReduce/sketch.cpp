@@ -0,0 +1,249 @@
+#include "headers.hpp"
+
+#include <cmath>
+
+/* registers of a HyperLogLog */
+const size_t SKETCH_REGISTERS = size_t(1) << SKETCH_PRECISION;
+
+CountMinSketch::CountMinSketch() : counters(SKETCH_DEPTH * SKETCH_WIDTH, 0) {
+}
+
+size_t CountMinSketch::cell(uint64_t hash, size_t row) const {
+    // rows are indexed by h1 + row * h2, two hashes derived from one
+    uint64_t step = ((hash * 0x9e3779b97f4a7c15ULL) >> 32) | 1;
+    return row * SKETCH_WIDTH + ((hash + row * step) & (SKETCH_WIDTH - 1));
+}
+
+void CountMinSketch::add(uint64_t hash, uint64_t count) {
+    for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+        this->counters[this->cell(hash, row)] += count;
+    }
+    this->sum += count;
+}
+
+uint64_t CountMinSketch::estimate(uint64_t hash) const {
+    uint64_t best = UINT64_MAX;
+    for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+        best = min(best, this->counters[this->cell(hash, row)]);
+    }
+    return best;
+}
+
+void CountMinSketch::merge(const CountMinSketch &other) {
+    for (size_t i = 0; i < this->counters.size(); i++) {
+        this->counters[i] += other.counters[i];
+    }
+    this->sum += other.sum;
+}
+
+uint64_t CountMinSketch::total() const {
+    return this->sum;
+}
+
+uint64_t CountMinSketch::bound() const {
+    return uint64_t(ceil(M_E / SKETCH_WIDTH * this->sum));
+}
+
+double CountMinSketch::confidence() {
+    return 1 - exp(-double(SKETCH_DEPTH));
+}
+
+void CountMinSketch::clear() {
+    fill(this->counters.begin(), this->counters.end(), 0);
+    this->sum = 0;
+}
+
+void CountMinSketch::encode(string &out) const {
+    putVarint(out, this->sum);
+    for (uint64_t counter : this->counters) {
+        putVarint(out, counter);
+    }
+}
+
+bool CountMinSketch::decode(string_view in, size_t &pos) {
+    if (!getVarint(in, pos, this->sum)) return false;
+    for (uint64_t &counter : this->counters) {
+        if (!getVarint(in, pos, counter)) return false;
+    }
+    return true;
+}
+
+HyperLogLog::HyperLogLog() : registers(SKETCH_REGISTERS, 0) {
+}
+
+void HyperLogLog::add(uint64_t hash) {
+    // the top bits pick the register, the rest give the rank of the first 1 bit
+    size_t index = hash >> (64 - SKETCH_PRECISION);
+    uint64_t rest = (hash << SKETCH_PRECISION) | (uint64_t(1) << (SKETCH_PRECISION - 1));
+    uint8_t rank = __builtin_clzll(rest) + 1;
+    this->registers[index] = max(this->registers[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+    for (size_t i = 0; i < this->registers.size(); i++) {
+        this->registers[i] = max(this->registers[i], other.registers[i]);
+    }
+}
+
+double HyperLogLog::estimate() const {
+    double m = SKETCH_REGISTERS, sum = 0;
+    size_t zeros = 0;
+    for (uint8_t r : this->registers) {
+        sum += ldexp(1.0, -r);
+        zeros += r == 0;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double raw = alpha * m * m / sum;
+
+    // few keys leave registers empty, and counting those is more accurate
+    if (raw <= 2.5 * m && zeros) return m * log(m / zeros);
+    return raw;
+}
+
+double HyperLogLog::error() {
+    return 1.04 / sqrt(double(SKETCH_REGISTERS));
+}
+
+void HyperLogLog::clear() {
+    fill(this->registers.begin(), this->registers.end(), 0);
+}
+
+void HyperLogLog::encode(string &out) const {
+    out.append((const char *) this->registers.data(), this->registers.size());
+}
+
+bool HyperLogLog::decode(string_view in, size_t &pos) {
+    if (in.size() - pos < this->registers.size()) return false;
+    memcpy(this->registers.data(), in.data() + pos, this->registers.size());
+    pos += this->registers.size();
+    return true;
+}
+
+ApproxSketch::ApproxSketch(size_t capacity) : capacity(max<size_t>(capacity, 1)), candidates(2 * this->capacity) {
+}
+
+void ApproxSketch::add(string_view key, uint64_t count) {
+    uint64_t hash = hashKey(key);
+    this->cms.add(hash, count);
+    this->hll.add(hash);
+
+    // most keys of a skewed stream never beat the weakest heavy hitter
+    uint64_t estimate = this->cms.estimate(hash);
+    if (estimate <= this->threshold) return;
+    this->candidates.add(key, estimate, [](uint64_t &acc, uint64_t value) {
+        acc = value;
+    });
+    if (this->candidates.size() >= 2 * this->capacity) this->prune();
+}
+
+void ApproxSketch::merge(const ApproxSketch &other) {
+    this->cms.merge(other.cms);
+    this->hll.merge(other.hll);
+    other.candidates.forEach([this](string_view key, uint64_t) {
+        this->candidates.add(key, 0);
+    });
+
+    // the estimates of both sides' candidates change with the merged counters
+    this->threshold = 0;
+    this->prune();
+}
+
+void ApproxSketch::prune() {
+    vector<pair<string_view, uint64_t>> entries = this->candidates.entries();
+    for (auto &entry : entries) {
+        entry.second = this->cms.estimate(hashKey(entry.first));
+    }
+    if (entries.size() > this->capacity) {
+        nth_element(entries.begin(), entries.begin() + this->capacity - 1, entries.end(), sortByValue);
+        entries.resize(this->capacity);
+        this->threshold = entries.back().second;
+    }
+
+    CountTable kept(2 * this->capacity);
+    for (auto &[key, estimate] : entries) {
+        kept.add(key, estimate);
+    }
+    this->candidates = move(kept);
+}
+
+vector<pair<string_view, uint64_t>> ApproxSketch::top(size_t k) const {
+    vector<pair<string_view, uint64_t>> entries = this->candidates.entries();
+    for (auto &entry : entries) {
+        entry.second = this->cms.estimate(hashKey(entry.first));
+    }
+    sort(entries.begin(), entries.end(), sortByValue);
+    if (entries.size() > k) entries.resize(k);
+    return entries;
+}
+
+const CountMinSketch &ApproxSketch::counts() const {
+    return this->cms;
+}
+
+const HyperLogLog &ApproxSketch::distinct() const {
+    return this->hll;
+}
+
+void ApproxSketch::clear() {
+    this->cms.clear();
+    this->hll.clear();
+    this->candidates.clear();
+    this->threshold = 0;
+}
+
+string ApproxSketch::encode() const {
+    string payload;
+    this->cms.encode(payload);
+    this->hll.encode(payload);
+    putVarint(payload, this->candidates.size());
+    this->candidates.forEach([&payload](string_view key, uint64_t) {
+        putVarint(payload, key.size());
+        payload.append(key);
+    });
+
+    SketchHeader header = {};
+    memcpy(header.magic, SKETCH_MAGIC, sizeof(header.magic));
+    header.version = SKETCH_VERSION;
+    header.depth = SKETCH_DEPTH;
+    header.width = SKETCH_WIDTH;
+    header.capacity = this->capacity;
+    header.payload = payload.size();
+    header.checksum = runChecksum(payload);
+
+    string out((const char *) &header, sizeof(header));
+    out.append(payload);
+    return out;
+}
+
+bool ApproxSketch::decode(string_view bytes, const string &name) {
+    SketchHeader header;
+    bool ok = bytes.size() >= sizeof(header);
+    if (ok) memcpy(&header, bytes.data(), sizeof(header));
+    ok = ok && memcmp(header.magic, SKETCH_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == SKETCH_VERSION && header.depth == SKETCH_DEPTH && header.width == SKETCH_WIDTH &&
+        header.payload == bytes.size() - sizeof(header);
+    string_view payload = ok ? bytes.substr(sizeof(header)) : string_view();
+    ok = ok && runChecksum(payload) == header.checksum;
+
+    this->clear();
+    size_t pos = 0;
+    uint64_t n = 0;
+    ok = ok && this->cms.decode(payload, pos) && this->hll.decode(payload, pos) && getVarint(payload, pos, n);
+    for (uint64_t i = 0; ok && i < n; i++) {
+        uint64_t length;
+        ok = getVarint(payload, pos, length) && length <= payload.size() - pos;
+        if (ok) {
+            this->candidates.add(payload.substr(pos, length), 0);
+            pos += length;
+        }
+    }
+    if (!ok) {
+        cerr << "Corrupt sketch: " << name << endl;
+        this->clear();
+        return false;
+    }
+
+    this->capacity = header.capacity;
+    this->prune();
+    return true;
+}
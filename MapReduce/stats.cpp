@@ -0,0 +1,244 @@
+#include "headers.hpp"
+
+static double cpuClockMs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+Stopwatch::Stopwatch(clockid_t cpu_clock) {
+    this->cpu_clock = cpu_clock;
+    this->wall = chrono::steady_clock::now();
+    this->cpu = cpuClockMs(cpu_clock);
+}
+
+double Stopwatch::wallMs() const {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - this->wall).count();
+}
+
+double Stopwatch::cpuMs() const {
+    return cpuClockMs(this->cpu_clock) - this->cpu;
+}
+
+/**
+ * @brief JsonWriter class
+ * Appends JSON to a string. Commas between members are inserted
+ * automatically, and nesting is indented by two spaces.
+*/
+class JsonWriter {
+    public:
+        string out;     /**< the JSON written so far */
+
+        void open(const char *name, char bracket) {
+            this->key(name);
+            this->out.push_back(bracket);
+            this->first = true;
+            this->depth++;
+        }
+
+        void close(char bracket) {
+            this->depth--;
+            if (!this->first) this->newline();
+            this->out.push_back(bracket);
+            this->first = false;
+        }
+
+        void value(const char *name, const string &s) {
+            this->key(name);
+            this->out.push_back('"');
+            for (char c : s) {
+                if (c == '"' || c == '\\') {
+                    this->out.push_back('\\');
+                    this->out.push_back(c);
+                } else if ((unsigned char) c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    this->out.append(escaped);
+                } else {
+                    this->out.push_back(c);
+                }
+            }
+            this->out.push_back('"');
+        }
+
+        void value(const char *name, double d) {
+            char digits[32];
+            snprintf(digits, sizeof(digits), "%.3f", d);
+            this->key(name);
+            this->out.append(digits);
+        }
+
+        void value(const char *name, uint64_t n) {
+            this->key(name);
+            this->out.append(to_string(n));
+        }
+
+        void value(const char *name, int n) {
+            this->key(name);
+            this->out.append(to_string(n));
+        }
+
+        void value(const char *name, bool b) {
+            this->key(name);
+            this->out.append(b ? "true" : "false");
+        }
+
+        void values(const char *name, const vector<uint64_t> &list) {
+            this->key(name);
+            this->out.push_back('[');
+            for (size_t i = 0; i < list.size(); i++) {
+                if (i) this->out.append(", ");
+                this->out.append(to_string(list[i]));
+            }
+            this->out.push_back(']');
+        }
+
+    private:
+        bool first = true;  /**< no member written at this level yet */
+        int depth = 0;      /**< nesting level */
+
+        void newline() {
+            this->out.push_back('\n');
+            this->out.append(2 * this->depth, ' ');
+        }
+
+        /* array elements and the root have no name */
+        void key(const char *name) {
+            if (!this->first) this->out.push_back(',');
+            if (this->depth > 0) this->newline();
+            this->first = false;
+            if (name) {
+                this->out.push_back('"');
+                this->out.append(name);
+                this->out.append("\": ");
+            }
+        }
+};
+
+static double skew(const vector<uint64_t> &values) {
+    if (values.empty()) return 0;
+    uint64_t total = 0, most = 0;
+    for (uint64_t v : values) {
+        total += v;
+        most = max(most, v);
+    }
+    return total ? most * double(values.size()) / total : 0;
+}
+
+static void writePhase(JsonWriter &json, const char *name, const PhaseStats &phase) {
+    double cpu_ms = 0;
+    for (const WorkerStats &worker : phase.workers) cpu_ms += worker.cpu_ms;
+
+    json.open(nullptr, '{');
+    json.value("name", string(name));
+    json.value("wall_ms", phase.wall_ms);
+    json.value("cpu_ms", cpu_ms);
+    json.open("workers", '[');
+    for (const WorkerStats &worker : phase.workers) {
+        json.open(nullptr, '{');
+        json.value("id", worker.id);
+        json.value("wall_ms", worker.wall_ms);
+        json.value("cpu_ms", worker.cpu_ms);
+        json.value("tasks", worker.tasks);
+        json.value("bytes_read", worker.bytes_read);
+        json.value("bytes_written", worker.bytes_written);
+        json.value("records_in", worker.records_in);
+        json.value("records_out", worker.records_out);
+        json.value("spills", worker.spills);
+        if (!worker.partition_records.empty()) {
+            json.values("partition_records", worker.partition_records);
+        } else {
+            json.value("keys", worker.keys);
+        }
+        json.close('}');
+    }
+    json.close(']');
+    json.close('}');
+}
+
+bool writeJobStats(const JobStats &stats, const Options &options, const string &filename) {
+    // records of each partition over all mappers, and distinct keys of each reducer
+    vector<uint64_t> partitions(options.nreduce), keys;
+    uint64_t bytes_read = 0, bytes_written = 0;
+    for (const WorkerStats &mapper : stats.map.workers) {
+        for (size_t i = 0; i < mapper.partition_records.size() && i < partitions.size(); i++) {
+            partitions[i] += mapper.partition_records[i];
+        }
+        bytes_read += mapper.bytes_read;
+    }
+    for (const WorkerStats &reducer : stats.reduce.workers) {
+        keys.push_back(reducer.keys);
+    }
+    for (const PhaseStats *phase : {&stats.map, &stats.reduce, &stats.merge}) {
+        for (const WorkerStats &worker : phase->workers) bytes_written += worker.bytes_written;
+    }
+
+    JsonWriter json;
+    json.open(nullptr, '{');
+    json.open("options", '{');
+    json.value("job", string(options.job == JOB_BIGRAMS ? "bigrams" : "wordcount"));
+    json.value("input_dir", options.input_dir);
+    json.value("output_dir", options.output_dir);
+    json.value("nworkers", options.nworkers);
+    json.value("nreduce", options.nreduce);
+    json.value("split_size", options.split_size);
+    json.value("memory_budget", options.memory_budget);
+    json.value("shuffle", string(options.shuffle == SHUFFLE_MEMORY ? "memory" : "file"));
+    json.value("io", string(options.io == IO_URING ? "uring" : options.io == IO_PREAD ? "pread" : "mmap"));
+    json.value("pipeline", options.pipeline);
+    json.value("combine", options.combine);
+    json.value("text_intermediate", options.text_intermediate);
+    json.value("dictionary", options.dictionary);
+    json.value("compress", options.compress);
+    json.value("top_k", options.top_k);
+    json.value("processes", options.processes);
+    json.value("backup_tasks", options.backup_tasks);
+    json.value("incremental", options.incremental);
+    json.value("rebuild", options.rebuild);
+    json.value("approx", options.approx);
+    json.value("watch", options.watch);
+    json.close('}');
+    json.value("wall_ms", stats.wall_ms);
+    json.value("cpu_ms", stats.cpu_ms);
+    json.value("bytes_read", bytes_read);
+    json.value("bytes_written", bytes_written);
+    json.open("phases", '[');
+    writePhase(json, "map", stats.map);
+    writePhase(json, "reduce", stats.reduce);
+    writePhase(json, "merge", stats.merge);
+    json.close(']');
+    json.open("backups", '{');
+    json.value("launched", stats.backups);
+    json.value("won", stats.backups_won);
+    json.close('}');
+    json.value("cached_files", stats.cached_files);
+    json.value("rounds", stats.rounds);
+    json.value("snapshots", stats.snapshots);
+    if (options.approx) {
+        json.open("approx", '{');
+        json.value("distinct_keys", stats.distinct_keys);
+        json.value("distinct_error", HyperLogLog::error());
+        json.value("max_overcount", stats.overcount);
+        json.value("confidence", CountMinSketch::confidence());
+        json.close('}');
+    }
+    json.open("partitions", '{');
+    json.values("records", partitions);
+    json.value("skew", skew(partitions));
+    json.close('}');
+    json.open("reducers", '{');
+    json.values("keys", keys);
+    json.value("skew", skew(keys));
+    json.close('}');
+    json.close('}');
+    json.out.push_back('\n');
+
+    ofstream output(filename, ios::binary);
+    output.write(json.out.data(), json.out.size());
+    output.close();
+    if (output.fail()) {
+        cerr << "Could not write job report: " << filename << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,94 @@
+# Tests for the multi-process mode: workers are killed or stopped in the
+# middle of a job, and the output must still match the threaded run. The
+# last test reuses one Master for two --watch jobs.
+#
+# Usage: ./tests.sh [corpus_size]
+
+# Build the project and the corpus generator
+make
+make bench
+
+size=${1:-48M}
+dir=$(mktemp -d)
+corpus="$dir/corpus"
+flags="--nworkers 4 --nreduce 3 --split-size 2M"
+failures=0
+
+./bench/corpus_gen "$corpus" "$size" > /dev/null
+
+# The threaded run is the expected output
+./mapreduce --input "$corpus" --output "$dir/expected" $flags > /dev/null
+
+# wait_for <file> <pattern>: wait up to 60 seconds for a line of the log
+wait_for() {
+    for i in $(seq 600); do
+        if grep -q "$2" "$1" 2> /dev/null; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    return 1
+}
+
+# run_test <name> <log pattern to wait for> <signal> <which worker> <log pattern expected> [extra flags]
+run_test() {
+    name=$1
+    out="$dir/$name"
+    log="$dir/$name.log"
+
+    ./mapreduce --input "$corpus" --output "$out" $flags --processes --worker-timeout 1000 $6 > "$log" 2>&1 &
+    master_pid=$!
+
+    # Signal the workers of this job once the job reached the given point
+    if [ -n "$3" ]; then
+        wait_for "$log" "$2"
+        pkill "-$3" $4 -f "mapreduce --worker $out/_master.sock"
+    fi
+
+    wait $master_pid
+    status=$?
+
+    if [ $status -ne 0 ]; then
+        echo "FAIL $name: master exited with status $status"
+        failures=$((failures + 1))
+    elif ! cmp -s "$out/output.txt" "$dir/expected/output.txt"; then
+        echo "FAIL $name: output differs from the threaded run"
+        failures=$((failures + 1))
+    elif [ -n "$5" ] && ! grep -q "$5" "$log"; then
+        echo "FAIL $name: no '$5' in $log"
+        failures=$((failures + 1))
+    else
+        echo "PASS $name"
+    fi
+}
+
+# No failures
+run_test no_failures "" "" "" ""
+
+# A worker crashes in the middle of a map task
+run_test kill_mapper "mapping file" KILL -n "re-executing map task"
+
+# A worker hangs in the middle of a map task and stops sending heartbeats
+run_test stop_mapper "mapping file" STOP -o "stopped sending heartbeats"
+
+# A worker hangs but its heartbeats would only time out after a minute, so a
+# backup copy of its map task must finish the job first
+run_test straggler "mapping file" STOP -o "finished first" "--worker-timeout 60000"
+
+# Every worker crashes at once in the map phase and the master spawns new ones
+run_test kill_all_mappers "mapping file" KILL "" "re-executing map task"
+
+# Every worker crashes at once in the middle of the reduce tasks
+run_test kill_all_reducers "Reducer" KILL "" "re-executing reduce task"
+
+# One Master runs two watches in a row, and each must count its own input
+if ! ./bench/watch_rerun test_files "$dir/watch_rerun" > /dev/null; then
+    echo "FAIL watch_rerun: a reused Master miscounted a watch"
+    failures=$((failures + 1))
+else
+    echo "PASS watch_rerun"
+fi
+
+rm -rf "$dir"
+echo "$failures test(s) failed"
+exit $failures
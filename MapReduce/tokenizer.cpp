@@ -0,0 +1,104 @@
+#include "headers.hpp"
+
+#include <immintrin.h>
+
+void classifyScalar(const char *p, ByteClasses &classes) {
+    classes = ByteClasses{0, 0, 0};
+    for (int i = 0; i < 64; i++) {
+        char c = p[i];
+        char l = c | 0x20;
+        uint64_t bit = 1ULL << i;
+        if (c == ' ' || c == '\n' || c == ',' || c == '\'') {
+            classes.delim |= bit;
+        } else if (l < 'a' || l > 'z') {
+            classes.reject |= bit;
+        } else if (c < 'a') {
+            classes.upper |= bit;
+        }
+    }
+}
+
+/**
+ * @brief Classify one 16-byte SSE vector
+*/
+__attribute__((target("sse4.2")))
+static inline void classify16(const char *p, uint32_t &delim, uint32_t &letter, uint32_t &upper) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    __m128i d = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(',')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')))
+    );
+
+    // bytes >= 0x80 are negative as signed chars and never pass the range check
+    __m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i is_letter = _mm_and_si128(
+        _mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+        _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), l)
+    );
+    __m128i is_upper = _mm_and_si128(is_letter, _mm_cmpgt_epi8(_mm_set1_epi8('a'), v));
+
+    delim = uint32_t(_mm_movemask_epi8(d));
+    letter = uint32_t(_mm_movemask_epi8(is_letter));
+    upper = uint32_t(_mm_movemask_epi8(is_upper));
+}
+
+__attribute__((target("sse4.2")))
+void classifySSE42(const char *p, ByteClasses &classes) {
+    uint64_t delim = 0, letter = 0, upper = 0;
+    for (int i = 0; i < 4; i++) {
+        uint32_t d, l, u;
+        classify16(p + 16 * i, d, l, u);
+        delim |= uint64_t(d) << (16 * i);
+        letter |= uint64_t(l) << (16 * i);
+        upper |= uint64_t(u) << (16 * i);
+    }
+    classes.delim = delim;
+    classes.reject = ~(delim | letter);
+    classes.upper = upper;
+}
+
+/**
+ * @brief Classify one 32-byte AVX2 vector
+*/
+__attribute__((target("avx2")))
+static inline void classify32(const char *p, uint32_t &delim, uint32_t &letter, uint32_t &upper) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) p);
+    __m256i d = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')))
+    );
+
+    __m256i l = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i is_letter = _mm256_and_si256(
+        _mm256_cmpgt_epi8(l, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), l)
+    );
+    __m256i is_upper = _mm256_and_si256(is_letter, _mm256_cmpgt_epi8(_mm256_set1_epi8('a'), v));
+
+    delim = uint32_t(_mm256_movemask_epi8(d));
+    letter = uint32_t(_mm256_movemask_epi8(is_letter));
+    upper = uint32_t(_mm256_movemask_epi8(is_upper));
+}
+
+__attribute__((target("avx2")))
+void classifyAVX2(const char *p, ByteClasses &classes) {
+    uint32_t d0, l0, u0, d1, l1, u1;
+    classify32(p, d0, l0, u0);
+    classify32(p + 32, d1, l1, u1);
+
+    uint64_t delim = d0 | (uint64_t(d1) << 32);
+    uint64_t letter = l0 | (uint64_t(l1) << 32);
+    classes.delim = delim;
+    classes.reject = ~(delim | letter);
+    classes.upper = u0 | (uint64_t(u1) << 32);
+}
+
+ClassifyKernel bestClassifyKernel() {
+    static ClassifyKernel best = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return classifyAVX2;
+        if (__builtin_cpu_supports("sse4.2")) return classifySSE42;
+        return classifyScalar;
+    }();
+    return best;
+}
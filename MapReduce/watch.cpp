@@ -0,0 +1,97 @@
+#include "headers.hpp"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+
+/* bytes of inotify events read at once */
+const size_t WATCH_EVENTS = 1 << 16;
+
+/* set by SIGINT and SIGTERM while a watch is running */
+static volatile sig_atomic_t stop_requested = 0;
+
+/* the handlers a watch replaced */
+static struct sigaction saved_int, saved_term;
+
+static void requestStop(int) {
+    stop_requested = 1;
+}
+
+DirectoryWatch::DirectoryWatch(const string &dir) : dir(dir), events(WATCH_EVENTS) {
+    // without SA_RESTART, the signal also wakes a poll in progress
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigemptyset(&action.sa_mask);
+    stop_requested = 0;
+    sigaction(SIGINT, &action, &saved_int);
+    sigaction(SIGTERM, &action, &saved_term);
+
+    this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (this->fd < 0 ||
+        inotify_add_watch(this->fd, dir.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO) < 0
+    ) {
+        cerr << "Could not watch input directory: " << dir << ": " << strerror(errno) << endl;
+        if (this->fd >= 0) close(this->fd);
+        this->fd = -1;
+    }
+}
+
+DirectoryWatch::~DirectoryWatch() {
+    if (this->fd >= 0) close(this->fd);
+    sigaction(SIGINT, &saved_int, nullptr);
+    sigaction(SIGTERM, &saved_term, nullptr);
+}
+
+bool DirectoryWatch::valid() const {
+    return this->fd >= 0;
+}
+
+bool DirectoryWatch::stopped() const {
+    return stop_requested;
+}
+
+bool DirectoryWatch::wait(uint64_t timeout_ms, unordered_set<string> &changed) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    while (this->fd >= 0 && !this->stopped()) {
+        int64_t left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        if (left <= 0) return true;
+
+        pollfd entry = {this->fd, POLLIN, 0};
+        int ready = poll(&entry, 1, left);
+        if (ready < 0 && errno != EINTR) return false;
+        if (ready <= 0) continue;
+
+        ssize_t n;
+        while ((n = read(this->fd, this->events.data(), this->events.size())) > 0) {
+            for (char *p = this->events.data(); p < this->events.data() + n;) {
+                inotify_event *event = (inotify_event *) p;
+                p += sizeof(inotify_event) + event->len;
+
+                // the queue overflowed, so any file may have changed
+                if (event->mask & IN_Q_OVERFLOW) {
+                    for (const string &path : listFiles(this->dir)) changed.insert(path);
+                    continue;
+                }
+                if (!event->len || event->mask & IN_ISDIR) continue;
+                filesystem::path path = filesystem::path(this->dir) / event->name;
+                if (path.extension() != ".txt") continue;
+                changed.insert(path.string());
+            }
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR) return false;
+    }
+    return false;
+}
+
+vector<string> DirectoryWatch::listFiles(const string &dir) {
+    vector<string> files;
+    error_code error;
+    for (const auto &entry : filesystem::directory_iterator(dir, error)) {
+        if (entry.path().extension() == ".txt") {
+            files.push_back(entry.path().string());
+        }
+    }
+    sort(files.begin(), files.end());
+    return files;
+}
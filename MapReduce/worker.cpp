@@ -0,0 +1,127 @@
+#include "headers.hpp"
+
+/* milliseconds between two heartbeats of a worker */
+const int HEARTBEAT_INTERVAL = 100;
+
+Worker::Worker(const string &socket_path) {
+    this->socket_path = socket_path;
+}
+
+int Worker::run() {
+    if (!this->connection.connectTo(this->socket_path)) {
+        cerr << "Could not connect to the master at " << this->socket_path << endl;
+        return 1;
+    }
+
+    Message message;
+    if (!this->send(Message(MSG_HELLO).put(uint64_t(getpid()))) ||
+        !this->connection.receive(message) || !this->readJob(message)
+    ) {
+        cerr << "Could not get the job from the master" << endl;
+        return 1;
+    }
+
+    std::thread beat(&Worker::heartbeat, this);
+    bool ok = this->send(Message(MSG_REQUEST));
+    while (ok && this->connection.receive(message) && message.type() != MSG_EXIT) {
+        uint64_t index;
+        if (!message.get(index)) break;
+
+        bool map = message.type() == MSG_MAP;
+        WorkerStats stats;
+        switch (this->options.job) {
+            case JOB_BIGRAMS:
+                stats = map ? this->mapTask<Bigrams>(index) : this->reduceTask<Bigrams>(index);
+                break;
+            default:
+                stats = map ? this->mapTask<WordCount>(index) : this->reduceTask<WordCount>(index);
+                break;
+        }
+
+        // DONE also asks for the next task
+        Message done(MSG_DONE);
+        done.put(map ? index : index + this->tasks.size());
+        putStats(done, stats);
+        ok = this->send(done);
+    }
+
+    {
+        lock_guard<mutex> guard(this->stop_lock);
+        this->stopping = true;
+    }
+    this->stop.notify_all();
+    beat.join();
+    return 0;
+}
+
+bool Worker::send(const Message &message) {
+    lock_guard<mutex> guard(this->send_lock);
+    return this->connection.send(message);
+}
+
+bool Worker::readJob(Message &message) {
+    if (message.type() != MSG_JOB) return false;
+
+    uint64_t nreduce, job, partition, combine, text_intermediate, dictionary, compress, incremental, io, approx, n;
+    bool ok = message.get(this->options.input_dir) && message.get(this->options.output_dir) &&
+        message.get(nreduce) && message.get(job) && message.get(partition) && message.get(combine) &&
+        message.get(text_intermediate) && message.get(this->options.split_size) &&
+        message.get(this->options.memory_budget) && message.get(dictionary) && message.get(compress) &&
+        message.get(this->options.top_k) && message.get(incremental) && message.get(io) && message.get(approx);
+    if (!ok) return false;
+    this->options.nreduce = nreduce;
+    this->options.job = JobKind(job);
+    this->options.partition = PartitionMode(partition);
+    this->options.combine = combine;
+    this->options.text_intermediate = text_intermediate;
+    this->options.incremental = incremental;
+    this->options.dictionary = dictionary;
+    this->options.compress = compress;
+    this->options.io = IoMode(io);
+    this->options.approx = approx;
+
+    if (!message.get(n)) return false;
+    this->files.resize(n);
+    for (string &file : this->files) {
+        if (!message.get(file)) return false;
+    }
+
+    if (!message.get(n)) return false;
+    this->tasks.resize(n);
+    for (MapTask &task : this->tasks) {
+        uint64_t file, cached;
+        if (!message.get(file) || !message.get(task.begin) || !message.get(task.end) || !message.get(cached)) return false;
+        task.file = file;
+        task.cached = cached;
+    }
+
+    if (!message.get(n)) return false;
+    vector<string> splits(n);
+    for (string &split : splits) {
+        if (!message.get(split)) return false;
+    }
+    this->partitioner = Partitioner(this->options.partition, this->options.nreduce, move(splits));
+    return true;
+}
+
+void Worker::heartbeat() {
+    unique_lock<mutex> guard(this->stop_lock);
+    while (!this->stop.wait_for(guard, chrono::milliseconds(HEARTBEAT_INTERVAL), [this] { return this->stopping; })) {
+        if (!this->send(Message(MSG_HEARTBEAT))) return;
+    }
+}
+
+template <typename Job>
+WorkerStats Worker::mapTask(int task) {
+    // the task index names the partition files, so every task writes its own
+    Mapper<Job> mapper(task, &this->options, &this->files, &this->tasks, nullptr, &this->partitioner, nullptr);
+    mapper.mapTask(task);
+    return mapper.getStats();
+}
+
+template <typename Job>
+WorkerStats Worker::reduceTask(int part) {
+    Reducer<Job> reducer(part, &this->options, this->tasks.size(), nullptr);
+    reducer.reduce();
+    return reducer.getStats();
+}